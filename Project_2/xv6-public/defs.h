@@ -4,6 +4,8 @@ struct file;
 struct inode;
 struct pipe;
 struct proc;
+struct rb_node;
+struct rb_root;
 struct rtcdate;
 struct spinlock;
 struct sleeplock;
@@ -53,6 +55,12 @@ int             readi(struct inode*, char*, uint, uint);
 void            stati(struct inode*, struct stat*);
 int             writei(struct inode*, char*, uint, uint);
 
+// hrtimer.c
+void            hrtimerinit(void);
+void            hrtimer_expire(void);
+uint64          hrtimer_next(void);
+int             nsleep(uint64);
+
 // ide.c
 void            ideinit(void);
 void            ideintr(void);
@@ -78,8 +86,14 @@ int             lapicid(void);
 extern volatile uint*    lapic;
 void            lapiceoi(void);
 void            lapicinit(void);
+void            lapicipi(int, int);
 void            lapicstartap(uchar, uint);
 void            microdelay(int);
+int             tickdue(void);
+void            timerset(uint64);
+void            tscinit(void);
+uint64          tsc2ns(uint64);
+uint64          ns2tsc(uint64);
 
 // log.c
 void            initlog(int dev);
@@ -122,8 +136,15 @@ void            wakeup(void*);
 void            yield(void);
 int             getnice(int);
 int             setnice(int, int);
+void            update_runtime(struct proc*);
 void            ps(int);
 
+// rbtree.c
+void            rb_erase(struct rb_root*, struct rb_node*);
+void            rb_insert(struct rb_root*, struct rb_node*, struct rb_node*,
+                          struct rb_node**, int);
+struct rb_node* rb_next(struct rb_node*);
+
 // swtch.S
 void            swtch(struct context**, struct context*);
 
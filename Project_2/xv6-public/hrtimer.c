@@ -0,0 +1,136 @@
+// High-resolution timers for sleeping processes.
+//
+// A process sleeping for a while goes in a red-black tree ordered
+// by its deadline, a TSC value, and sleeps on &p->deadline.  Every
+// CPU arms its LAPIC timer no later than the earliest deadline (see
+// timerset() in lapic.c), and whichever timer interrupt comes first
+// after it wakes the processes whose deadlines have passed, each
+// just once.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "x86.h"
+#include "proc.h"
+#include "spinlock.h"
+
+struct {
+  struct spinlock lock;
+  struct rb_root tree;       // Sleeping processes, by deadline
+  // The earliest deadline, or 0, for timerset() to read without
+  // the lock: it cannot take the lock, since it may run under
+  // a runqueue lock, which sleep() takes while holding this one.
+  // seq is odd while next is being written.
+  volatile uint seq;
+  volatile uint64 next;
+} hrtimers;
+
+void
+hrtimerinit(void)
+{
+  initlock(&hrtimers.lock, "hrtimers");
+}
+
+#define hr_proc(n) ((struct proc*)((char*)(n) - (uint)&((struct proc*)0)->hrnode))
+
+static void
+setnext(void)
+{
+  hrtimers.seq++;
+  __sync_synchronize();
+  hrtimers.next = hrtimers.tree.leftmost ? hr_proc(hrtimers.tree.leftmost)->deadline : 0;
+  __sync_synchronize();
+  hrtimers.seq++;
+}
+
+static void
+insert(struct proc *p)
+{
+  struct rb_node **link, *parent;
+  int leftmost;
+
+  link = &hrtimers.tree.node;
+  parent = 0;
+  leftmost = 1;
+  while(*link){
+    parent = *link;
+    if(p->deadline < hr_proc(parent)->deadline)
+      link = &parent->left;
+    else {
+      link = &parent->right;
+      leftmost = 0;
+    }
+  }
+  rb_insert(&hrtimers.tree, &p->hrnode, parent, link, leftmost);
+  setnext();
+}
+
+static void
+remove(struct proc *p)
+{
+  rb_erase(&hrtimers.tree, &p->hrnode);
+  p->deadline = 0;
+  setnext();
+}
+
+// The earliest deadline of any sleeping process, or 0.
+uint64
+hrtimer_next(void)
+{
+  uint s;
+  uint64 v;
+
+  for(;;){
+    s = hrtimers.seq;
+    __sync_synchronize();
+    v = hrtimers.next;
+    __sync_synchronize();
+    if((s & 1) == 0 && s == hrtimers.seq)
+      return v;
+  }
+}
+
+// Wake the processes whose deadlines have passed.
+// Called on timer interrupts.
+void
+hrtimer_expire(void)
+{
+  struct proc *p;
+  uint64 next, now;
+
+  now = rdtsc();
+  next = hrtimer_next();
+  if(next == 0 || next > now)
+    return;
+
+  acquire(&hrtimers.lock);
+  while(hrtimers.tree.leftmost &&
+        (p = hr_proc(hrtimers.tree.leftmost))->deadline <= now){
+    remove(p);
+    wakeup(&p->deadline);
+  }
+  release(&hrtimers.lock);
+}
+
+// Sleep for ns nanoseconds.  Returns -1 if killed first.
+int
+nsleep(uint64 ns)
+{
+  struct proc *p = myproc();
+
+  acquire(&hrtimers.lock);
+  p->deadline = rdtsc() + ns2tsc(ns);
+  insert(p);
+  while(p->deadline){
+    if(p->killed){
+      remove(p);
+      release(&hrtimers.lock);
+      return -1;
+    }
+    sleep(&p->deadline, &hrtimers.lock);
+  }
+  release(&hrtimers.lock);
+  return 0;
+}
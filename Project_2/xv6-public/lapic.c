@@ -32,6 +32,7 @@
 #define TIMER   (0x0320/4)   // Local Vector Table 0 (TIMER)
   #define X1         0x0000000B   // divide counts by 1
   #define PERIODIC   0x00020000   // Periodic
+  #define ONESHOT    0x00000000   // One-shot
 #define PCINT   (0x0340/4)   // Performance Counter LVT
 #define LINT0   (0x0350/4)   // Local Vector Table 1 (LINT0)
 #define LINT1   (0x0360/4)   // Local Vector Table 2 (LINT1)
@@ -60,13 +61,11 @@ lapicinit(void)
   // Enable local APIC; set spurious interrupt vector.
   lapicw(SVR, ENABLE | (T_IRQ0 + IRQ_SPURIOUS));
 
-  // The timer repeatedly counts down at bus frequency
-  // from lapic[TICR] and then issues an interrupt.
-  // If xv6 cared more about precise timekeeping,
-  // TICR would be calibrated using an external time source.
+  // The timer counts down once at bus frequency from
+  // lapic[TICR] and then issues an interrupt.  It stays off
+  // until timerset() arms it, once tscinit() knows its rate.
   lapicw(TDCR, X1);
-  lapicw(TIMER, PERIODIC | (T_IRQ0 + IRQ_TIMER));
-  lapicw(TICR, 10000000);
+  lapicw(TIMER, MASKED | (T_IRQ0 + IRQ_TIMER));
 
   // Disable logical interrupt lines.
   lapicw(LINT0, MASKED);
@@ -97,6 +96,16 @@ lapicinit(void)
   lapicw(TPR, 0);
 }
 
+// Interrupt the CPU with the given APIC ID with vector.
+void
+lapicipi(int apicid, int vector)
+{
+  lapicw(ICRHI, apicid<<24);
+  lapicw(ICRLO, FIXED | ASSERT | vector);
+  while(lapic[ICRLO] & DELIVS)
+    ;
+}
+
 int
 lapicid(void)
 {
@@ -120,6 +129,133 @@ microdelay(int us)
 {
 }
 
+// The rates of the time stamp counter and of the LAPIC timer,
+// measured at boot against channel 2 of the 8254 PIT, whose input
+// clock is PIT_HZ.
+#define PIT_HZ       1193182
+#define PIT_CH2      0x42
+#define PIT_MODE     0x43
+#define PIT_GATE     0x61      // Channel 2 gate and output
+#define CALIBRATE_MS 10
+
+static uint tsc_khz;
+static uint lapic_khz;
+static uint64 nexttick;        // TSC of CPU 0's next tick
+
+void
+tscinit(void)
+{
+  uint latch, spins, count;
+  uint64 t0, t1;
+
+  // Gate channel 2 on with the speaker off, and have it count
+  // down once from latch; its output goes high at zero.
+  latch = PIT_HZ / (1000 / CALIBRATE_MS);
+  outb(PIT_GATE, (inb(PIT_GATE) & ~0x02) | 0x01);
+  outb(PIT_MODE, 0xB0);  // channel 2, lobyte/hibyte, mode 0
+  outb(PIT_CH2, latch & 0xFF);
+  outb(PIT_CH2, latch >> 8);
+
+  // Let the LAPIC timer count down, masked, over the same time.
+  lapicw(TIMER, MASKED | (T_IRQ0 + IRQ_TIMER));
+  lapicw(TICR, 0xFFFFFFFF);
+
+  t0 = rdtsc();
+  for(spins = 0; (inb(PIT_GATE) & 0x20) == 0; spins++)
+    if(spins > 10000000)
+      break;
+  t1 = rdtsc();
+  count = 0xFFFFFFFF - lapic[TCCR];
+  lapicw(TICR, 0);
+
+  if((inb(PIT_GATE) & 0x20) == 0 || t1 == t0 || count == 0){
+    tsc_khz = lapic_khz = 1000000;
+    cprintf("tscinit: no PIT, assuming 1 GHz\n");
+  } else {
+    tsc_khz = divu64(t1 - t0, CALIBRATE_MS);
+    lapic_khz = count / CALIBRATE_MS;
+  }
+
+  nexttick = rdtsc();
+  timerset(0);
+}
+
+// Nanoseconds in the given number of TSC cycles.
+uint64
+tsc2ns(uint64 cycles)
+{
+  return divu64(cycles * 1000000, tsc_khz);
+}
+
+// Called on CPU 0's timer interrupts: is the next tick due?
+int
+tickdue(void)
+{
+  uint64 now, period;
+
+  now = rdtsc();
+  if(now < nexttick)
+    return 0;
+  period = divu64((uint64)TICKNS * tsc_khz, 1000000);
+  nexttick += period;
+  if(nexttick <= now)
+    nexttick = now + period;
+  return 1;
+}
+
+// TSC cycles in the given number of nanoseconds.
+uint64
+ns2tsc(uint64 ns)
+{
+  uint64 ms;
+
+  ms = divu64(ns, 1000000);
+  return ms * tsc_khz + divu64((ns - ms*1000000) * tsc_khz, 1000000);
+}
+
+// Lower *ns, if need be, to the time until the TSC reaches
+// deadline; 0 in *ns means no time yet.
+static void
+sooner(uint64 *ns, uint64 deadline, uint64 now)
+{
+  uint64 d;
+
+  d = deadline > now ? tsc2ns(deadline - now) : 0;
+  if(d == 0)
+    d = 1;
+  if(*ns == 0 || d < *ns)
+    *ns = d;
+}
+
+// Have the LAPIC timer of this CPU interrupt once, ns from now.
+// It comes sooner if a sleeping process's deadline does, or, on
+// CPU 0, the next tick.  ns of 0 means no interrupt but those.
+void
+timerset(uint64 ns)
+{
+  uint64 now, next, count;
+
+  now = rdtsc();
+  if(cpuid() == 0)
+    sooner(&ns, nexttick, now);
+  if((next = hrtimer_next()) != 0)
+    sooner(&ns, next, now);
+  if(ns == 0){
+    lapicw(TIMER, MASKED | (T_IRQ0 + IRQ_TIMER));
+    lapicw(TICR, 0);
+    return;
+  }
+  if(ns > 1000000000)
+    ns = 1000000000;  // the counter is only 32 bits
+  count = divu64(ns * lapic_khz, 1000000);
+  if(count == 0)
+    count = 1;
+  if(count > 0xFFFFFFFF)
+    count = 0xFFFFFFFF;
+  lapicw(TIMER, ONESHOT | (T_IRQ0 + IRQ_TIMER));
+  lapicw(TICR, count);
+}
+
 #define CMOS_PORT    0x70
 #define CMOS_RETURN  0x71
 
@@ -21,6 +21,7 @@ main(void)
   kvmalloc();      // kernel page table
   mpinit();        // detect other processors
   lapicinit();     // interrupt controller
+  tscinit();       // TSC and LAPIC timer rates
   seginit();       // segment descriptors
   picinit();       // disable pic
   ioapicinit();    // another interrupt controller
@@ -28,6 +29,7 @@ main(void)
   uartinit();      // serial port
   pinit();         // process table
   tvinit();        // trap vectors
+  hrtimerinit();   // sleep timers
   binit();         // buffer cache
   fileinit();      // file table
   ideinit();       // disk 
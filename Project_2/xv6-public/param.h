@@ -1,4 +1,4 @@
-#define NPROC        64  // maximum number of processes
+#define PROCPAGES     8  // pages of memory per process allowed
 #define KSTACKSIZE 4096  // size of per-process kernel stack
 #define NCPU          8  // maximum number of CPUs
 #define NOFILE       16  // open files per process
@@ -11,4 +11,5 @@
 #define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
 #define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
 #define FSSIZE       1000  // size of file system in blocks
+#define TICKNS   10000000  // nanoseconds per timer tick
 
@@ -5,6 +5,7 @@
 #include "mmu.h"
 #include "x86.h"
 #include "proc.h"
+#include "traps.h"
 #include "spinlock.h"
 
 int weight_table[40] = 
@@ -19,25 +20,408 @@ int weight_table[40] =
   36,     29,     23,     18,     15
 };
 
-unsigned int total_weight = 0;
+#define NSLEEPQ 61
+#define NPIDHASH 251
+#define PROCPERPG (PGSIZE / sizeof(struct proc))
 
+// Proc structures come from whole pages, PROCPERPG at a time, as
+// processes are created, and are kept for reuse once free.  At most
+// maxproc are in use at once; pinit() sets it from the size of
+// physical memory.  ptable.lock protects the table, parent links
+// and the move to ZOMBIE; the scheduler never takes it.
 struct {
   struct spinlock lock;
-  struct proc proc[NPROC];
+  struct proc *all;              // Every proc structure, through allnext
+  struct proc *free;             // UNUSED ones, through qnext
+  struct proc *pidhash[NPIDHASH];  // Processes by pid, through pidnext
+  int nused;                     // Not UNUSED
 } ptable;
 
+// SLEEPING processes, hashed by chan, through qnext.  Each queue's
+// lock protects it and the chan of the processes on it; it is taken
+// before any runqueue lock.
+struct sleepq {
+  struct spinlock lock;
+  struct proc *head;
+} sleepqs[NSLEEPQ];
+
+int maxproc;
+extern char end[];  // first address after kernel, from kernel.ld
+
+// Each CPU has a runqueue: the RUNNABLE processes that will run on
+// it, in a red-black tree ordered by vruntime.  A process is in
+// the tree of runqueues[p->cpu] while RUNNABLE; while RUNNING it is
+// that runqueue's curr instead.
+//
+// rq->lock protects a runqueue's fields and the state of the
+// processes on it, and p->cpu only changes with the locks of both
+// runqueues held (see migrate()).  A process gives up its CPU by
+// calling sched() holding rq->lock of that CPU and nothing else;
+// the scheduler switches to the next process still holding it, and
+// that process releases it.  So whoever takes rq->lock of a process
+// that has stopped running knows it is off the CPU.
+struct runqueue {
+  struct spinlock lock;
+  struct rb_root tree;
+  struct proc *curr;    // Process running on this CPU, or 0
+  int nqueued;          // Processes in tree
+  uint load;            // Weight of the processes in tree and curr
+  uint64 min_vruntime;  // Smallest vruntime here; never decreases
+  uint lastbalance;     // ticks at the last balance()
+  uint lastfail;        // ticks at the last failed steal()
+  uint steals;          // Processes taken by steal()
+  uint failed_steals;   // steal() calls that found none to take
+  int halted;           // CPU is in hlt; wake it with an IPI
+} runqueues[NCPU];
+
+#define BALANCETICKS 4   // ticks between balance() runs on a CPU
+#define CACHEHOTTICKS 1  // ticks a process stays cache hot after running
+
+#define rb_proc(n) ((struct proc*)((char*)(n) - (uint)&((struct proc*)0)->rb))
+
 static struct proc *initproc;
 
 int nextpid = 1;
 extern void forkret(void);
 extern void trapret(void);
 
-static void wakeup1(void *chan);
+static struct sleepq*
+sleepq(void *chan)
+{
+  return &sleepqs[(uint)chan % NSLEEPQ];
+}
+
+static struct proc**
+pidhash(int pid)
+{
+  return &ptable.pidhash[(uint)pid % NPIDHASH];
+}
+
+// The process with the given pid, or 0.
+// Caller must hold ptable.lock.
+static struct proc*
+findproc(int pid)
+{
+  struct proc *p;
+
+  for(p = *pidhash(pid); p; p = p->pidnext)
+    if(p->pid == pid)
+      return p;
+  return 0;
+}
+
+// Return p to the free list, making it UNUSED.
+// Caller must hold ptable.lock.
+static void
+freeproc(struct proc *p)
+{
+  struct proc **pp;
+
+  for(pp = pidhash(p->pid); *pp != p; pp = &(*pp)->pidnext)
+    ;
+  *pp = p->pidnext;
+  p->pid = 0;
+  p->state = UNUSED;
+  p->qnext = ptable.free;
+  ptable.free = p;
+  ptable.nused--;
+}
+
+static struct runqueue*
+rq_of(struct proc *p)
+{
+  return &runqueues[p->cpu];
+}
+
+// Lock the runqueue of p, which may be moving between runqueues
+// meanwhile, and return it.
+static struct runqueue*
+lock_rq_of(struct proc *p)
+{
+  struct runqueue *rq;
+
+  for(;;){
+    rq = rq_of(p);
+    acquire(&rq->lock);
+    if(rq == rq_of(p))
+      return rq;
+    release(&rq->lock);
+  }
+}
+
+// Move rq->min_vruntime up to the smallest vruntime of
+// the processes on rq, if that is larger.
+static void
+update_min_vruntime(struct runqueue *rq)
+{
+  struct proc *first;
+  uint64 v;
+
+  first = rq->tree.leftmost ? rb_proc(rq->tree.leftmost) : 0;
+  if(rq->curr)
+    v = rq->curr->vruntime;
+  else if(first)
+    v = first->vruntime;
+  else
+    return;
+  if(first && first->vruntime < v)
+    v = first->vruntime;
+  if(v > rq->min_vruntime)
+    rq->min_vruntime = v;
+}
+
+// Put p in the tree of rq.  Processes with equal vruntime run
+// in the order they came.  Caller must hold rq->lock.
+static void
+enqueue(struct runqueue *rq, struct proc *p)
+{
+  struct rb_node **link, *parent;
+  int leftmost;
+
+  link = &rq->tree.node;
+  parent = 0;
+  leftmost = 1;
+  while(*link){
+    parent = *link;
+    if(p->vruntime < rb_proc(parent)->vruntime)
+      link = &parent->left;
+    else {
+      link = &parent->right;
+      leftmost = 0;
+    }
+  }
+  rb_insert(&rq->tree, &p->rb, parent, link, leftmost);
+  rq->nqueued++;
+}
+
+// Take p out of the tree of rq.  Caller must hold rq->lock.
+static void
+dequeue(struct runqueue *rq, struct proc *p)
+{
+  rb_erase(&rq->tree, &p->rb);
+  rq->nqueued--;
+}
+
+// Carry p's place relative to the processes of runqueue from
+// over to those of runqueue to.
+static void
+renormalize(struct proc *p, struct runqueue *from, struct runqueue *to)
+{
+  if(p->vruntime > from->min_vruntime)
+    p->vruntime = p->vruntime - from->min_vruntime + to->min_vruntime;
+  else if(from->min_vruntime - p->vruntime < to->min_vruntime)
+    p->vruntime = to->min_vruntime - (from->min_vruntime - p->vruntime);
+  else
+    p->vruntime = 0;
+}
+
+// rq has just been given a process.  If its CPU is halted, wake
+// it.  If its CPU already has something to run, wake some halted
+// CPU instead, so that it can steal.
+static void
+kick(struct runqueue *rq)
+{
+  struct runqueue *r;
+
+  // Pairs with the barrier in halt(): either we see the flag,
+  // or the halting CPU sees the process.
+  __sync_synchronize();
+  if(!rq->halted){
+    if(rq->curr == 0 && rq->nqueued <= 1)
+      return;
+    for(r = runqueues; r < &runqueues[ncpu]; r++)
+      if(r->halted)
+        break;
+    if(r == &runqueues[ncpu])
+      return;
+    rq = r;
+  }
+  lapicipi(cpus[rq - runqueues].apicid, T_IRQ0 + IRQ_WAKEUP);
+}
+
+// Make p, new or sleeping, RUNNABLE on the runqueue of p->cpu.  A
+// sleeper comes back one tick of its own ahead of the processes
+// there.  Taking rq->lock first waits for a sleeper to get off its
+// CPU, so it cannot be picked while still running.
+static void
+activate(struct proc *p)
+{
+  struct runqueue *rq = rq_of(p);
+  uint64 one_tick;
+
+  acquire(&rq->lock);
+  if(p->state == SLEEPING){
+    one_tick = divu64((uint64)TICKNS*1024, weight_table[p->nice]);
+    p->vruntime = 0;
+    if(rq->min_vruntime > one_tick)
+      p->vruntime = rq->min_vruntime - one_tick;
+  }
+  p->state = RUNNABLE;
+  rq->load += weight_table[p->nice];
+  enqueue(rq, p);
+  update_min_vruntime(rq);
+  kick(rq);
+  release(&rq->lock);
+}
+
+// The runqueue with the least load.
+static struct runqueue*
+idlest_rq(void)
+{
+  struct runqueue *rq, *best;
+
+  best = &runqueues[0];
+  for(rq = runqueues; rq < &runqueues[ncpu]; rq++)
+    if(rq->load < best->load)
+      best = rq;
+  return best;
+}
+
+// The most loaded runqueue other than rq that has processes
+// queued, or 0.  Read without the locks, the answer is only a hint.
+static struct runqueue*
+busiest_rq(struct runqueue *rq)
+{
+  struct runqueue *r, *busiest;
+
+  busiest = 0;
+  for(r = runqueues; r < &runqueues[ncpu]; r++)
+    if(r != rq && r->nqueued > 0 && (busiest == 0 || r->load > busiest->load))
+      busiest = r;
+  return busiest;
+}
+
+// Lock two runqueues in address order, so that two CPUs
+// taking the same pair cannot deadlock.
+static void
+lock_pair(struct runqueue *a, struct runqueue *b)
+{
+  acquire(&(a < b ? a : b)->lock);
+  acquire(&(a < b ? b : a)->lock);
+}
+
+static void
+unlock_pair(struct runqueue *a, struct runqueue *b)
+{
+  release(&(a < b ? b : a)->lock);
+  release(&(a < b ? a : b)->lock);
+}
+
+// Move queued process p from runqueue from to runqueue to.
+// Caller must hold both runqueue locks.
+static void
+migrate(struct proc *p, struct runqueue *from, struct runqueue *to)
+{
+  uint w = weight_table[p->nice];
+
+  dequeue(from, p);
+  from->load -= w;
+  renormalize(p, from, to);
+  p->cpu = to - runqueues;
+  enqueue(to, p);
+  to->load += w;
+  update_min_vruntime(to);
+}
+
+// Pull processes to this CPU's runqueue rq from the busiest one,
+// until their weighted loads are about even.  Only queued processes
+// move, never one that is running.  Caller must hold no runqueue
+// lock.
+static void
+balance(struct runqueue *rq)
+{
+  struct runqueue *busiest;
+  struct rb_node *n, *next;
+  struct proc *p;
+  uint imbalance, w;
+
+  rq->lastbalance = ticks;
+  if((busiest = busiest_rq(rq)) == 0)
+    return;
+
+  lock_pair(rq, busiest);
+  if(busiest->load > rq->load){
+    imbalance = (busiest->load - rq->load) / 2;
+    for(n = busiest->tree.leftmost; n && imbalance > 0; n = next){
+      next = rb_next(n);
+      p = rb_proc(n);
+      w = weight_table[p->nice];
+      if(w > imbalance)
+        continue;
+      migrate(p, busiest, rq);
+      imbalance -= w;
+    }
+  }
+  unlock_pair(rq, busiest);
+}
+
+// This CPU, with runqueue rq, has nothing to run: take one process
+// from the busiest runqueue, the one furthest behind its fair share
+// (smallest vruntime) that is not cache hot.  A process is cache
+// hot on its CPU if it ran there within the last CACHEHOTTICKS
+// ticks.  Returns 1 if it took one.  Caller must hold no runqueue
+// lock.
+static int
+steal(struct runqueue *rq)
+{
+  struct runqueue *busiest;
+  struct rb_node *n;
+  struct proc *p;
+
+  if((busiest = busiest_rq(rq)) == 0)
+    return 0;
+
+  lock_pair(rq, busiest);
+  for(n = busiest->tree.leftmost; n; n = rb_next(n)){
+    p = rb_proc(n);
+    if(ticks - p->lastran >= CACHEHOTTICKS){
+      migrate(p, busiest, rq);
+      rq->steals++;
+      unlock_pair(rq, busiest);
+      return 1;
+    }
+  }
+  rq->failed_steals++;
+  rq->lastfail = ticks;
+  unlock_pair(rq, busiest);
+  return 0;
+}
+
+// Halt this CPU, with runqueue rq, until an interrupt.  If some
+// other runqueue has a backlog to steal from later, come back in a
+// tick; otherwise set no timer at all (CPU 0 still gets its tick,
+// since it counts ticks).  A CPU that gives rq or any runqueue work
+// sends an IPI (see kick()).
+static void
+halt(struct runqueue *rq)
+{
+  cli();
+  acquire(&rq->lock);
+  rq->halted = 1;
+  release(&rq->lock);
+  __sync_synchronize();
+  if(rq->nqueued == 0){
+    timerset(busiest_rq(rq) ? TICKNS : 0);
+    sti_hlt();
+    cli();
+  }
+  acquire(&rq->lock);
+  rq->halted = 0;
+  release(&rq->lock);
+}
 
 void
 pinit(void)
 {
+  struct runqueue *rq;
+  struct sleepq *q;
+
   initlock(&ptable.lock, "ptable");
+  maxproc = (PHYSTOP - V2P(end)) / PGSIZE / PROCPAGES;
+  for(rq = runqueues; rq < &runqueues[NCPU]; rq++)
+    initlock(&rq->lock, "runqueue");
+  for(q = sleepqs; q < &sleepqs[NSLEEPQ]; q++)
+    initlock(&q->lock, "sleepq");
 }
 
 // Must be called with interrupts disabled
@@ -79,8 +463,31 @@ myproc(void) {
   return p;
 }
 
+// Add a page of UNUSED proc structures to the free list.
+// Returns -1 if out of memory.  Caller must hold ptable.lock.
+static int
+growptable(void)
+{
+  struct proc *p;
+  char *page;
+  int i;
+
+  if((page = kalloc()) == 0)
+    return -1;
+  memset(page, 0, PGSIZE);
+  for(i = 0; i < PROCPERPG; i++){
+    p = (struct proc*)page + i;
+    p->allnext = ptable.all;
+    ptable.all = p;
+    p->qnext = ptable.free;
+    ptable.free = p;
+  }
+  return 0;
+}
+
 //PAGEBREAK: 32
-// Look in the process table for an UNUSED proc.
+// Take an UNUSED proc from the free list, growing the process
+// table if need be, unless maxproc are in use.
 // If found, change state to EMBRYO and initialize
 // state required to run in the kernel.
 // Otherwise return 0.
@@ -92,16 +499,18 @@ allocproc(void)
 
   acquire(&ptable.lock);
 
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
-    if(p->state == UNUSED)
-      goto found;
-
-  release(&ptable.lock);
-  return 0;
+  if(ptable.nused >= maxproc || (ptable.free == 0 && growptable() < 0)){
+    release(&ptable.lock);
+    return 0;
+  }
+  p = ptable.free;
+  ptable.free = p->qnext;
+  ptable.nused++;
 
-found:
   p->state = EMBRYO;
   p->pid = nextpid++;
+  p->pidnext = *pidhash(p->pid);
+  *pidhash(p->pid) = p;
   p->nice = 20;
 
   p->cur_runtime = 0;
@@ -109,14 +518,13 @@ found:
   p->vruntime = 0;
   p->time_slice = 0; // 0 for now
 
-  p->overflow_times = 0;
-  
-
   release(&ptable.lock);
 
   // Allocate kernel stack.
   if((p->kstack = kalloc()) == 0){
-    p->state = UNUSED;
+    acquire(&ptable.lock);
+    freeproc(p);
+    release(&ptable.lock);
     return 0;
   }
   sp = p->kstack + KSTACKSIZE;
@@ -165,15 +573,11 @@ userinit(void)
   safestrcpy(p->name, "initcode", sizeof(p->name));
   p->cwd = namei("/");
 
-  // this assignment to p->state lets other cores
-  // run this process. the acquire forces the above
-  // writes to be visible, and the lock is also needed
-  // because the assignment might not be atomic.
-  acquire(&ptable.lock);
-
-  p->state = RUNNABLE;
-
-  release(&ptable.lock);
+  // activate() lets other cores run this process.  It
+  // changes p->state under the runqueue lock, which also
+  // makes the above writes visible.
+  p->cpu = 0;
+  activate(p);
 }
 
 // Grow current process's memory by n bytes.
@@ -216,14 +620,15 @@ fork(void)
   if((np->pgdir = copyuvm(curproc->pgdir, curproc->sz)) == 0){
     kfree(np->kstack);
     np->kstack = 0;
-    np->state = UNUSED;
+    acquire(&ptable.lock);
+    freeproc(np);
+    release(&ptable.lock);
     return -1;
   }
   np->sz = curproc->sz;
   np->parent = curproc;
 
   np->nice = curproc->nice;
-  np->overflow_times = curproc->overflow_times;
   np->vruntime = curproc->vruntime;
 
   *np->tf = *curproc->tf;
@@ -240,11 +645,11 @@ fork(void)
 
   pid = np->pid;
 
-  acquire(&ptable.lock);
-
-  np->state = RUNNABLE;
-
-  release(&ptable.lock);
+  // Start the child on the least loaded CPU, keeping
+  // its parent's place there.
+  np->cpu = idlest_rq() - runqueues;
+  renormalize(np, rq_of(curproc), rq_of(np));
+  activate(np);
 
   return pid;
 }
@@ -278,19 +683,22 @@ exit(void)
   acquire(&ptable.lock);
 
   // Parent might be sleeping in wait().
-  wakeup1(curproc->parent);
+  wakeup(curproc->parent);
 
   // Pass abandoned children to init.
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+  for(p = ptable.all; p; p = p->allnext){
     if(p->parent == curproc){
       p->parent = initproc;
       if(p->state == ZOMBIE)
-        wakeup1(initproc);
+        wakeup(initproc);
     }
   }
 
-  // Jump into the scheduler, never to return.
+  // Jump into the scheduler, never to return.  wait() cannot
+  // free us before the scheduler lets go of the runqueue lock.
+  acquire(&rq_of(curproc)->lock);
   curproc->state = ZOMBIE;
+  release(&ptable.lock);
   sched();
   panic("zombie exit");
 }
@@ -308,21 +716,23 @@ wait(void)
   for(;;){
     // Scan through table looking for exited children.
     havekids = 0;
-    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+    for(p = ptable.all; p; p = p->allnext){
       if(p->parent != curproc)
         continue;
       havekids = 1;
       if(p->state == ZOMBIE){
-        // Found one.
+        // Found one.  Its kernel stack is in use until its
+        // CPU has switched away and released the runqueue lock.
+        acquire(&rq_of(p)->lock);
+        release(&rq_of(p)->lock);
         pid = p->pid;
         kfree(p->kstack);
         p->kstack = 0;
         freevm(p->pgdir);
-        p->pid = 0;
         p->parent = 0;
         p->name[0] = 0;
         p->killed = 0;
-        p->state = UNUSED;
+        freeproc(p);
         release(&ptable.lock);
         return pid;
       }
@@ -334,7 +744,7 @@ wait(void)
       return -1;
     }
 
-    // Wait for children to exit.  (See wakeup1 call in proc_exit.)
+    // Wait for children to exit.  (See wakeup call in proc_exit.)
     sleep(curproc, &ptable.lock);  //DOC: wait-sleep
   }
 }
@@ -352,79 +762,90 @@ scheduler(void)
 {
   struct proc *p;
   struct cpu *c = mycpu();
+  struct runqueue *rq = &runqueues[c - cpus];
+  int idle;
   c->proc = 0;
   
   for(;;){
     // Enable interrupts on this processor.
     sti();
 
-    struct proc *min_vrun_proc = 0;
-    int is_there_min_proc = 0;
-    unsigned int min_vruntime = (unsigned int) -1;
-    unsigned int min_overflow_times = (unsigned int) -1;
-
-    acquire(&ptable.lock);
-
-    total_weight = 0;
-
-    // Get total weight of the process
-    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-      if(p->state == RUNNABLE)
-        total_weight += weight_table[p->nice];
-    }
-
-    // Set time slice for every process
-    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-      if(p->state == RUNNABLE)
-         p->time_slice = 1000*10*weight_table[p->nice]/total_weight;
+    // Halt while there is nothing to do here and, as far as we
+    // can tell, nothing to steal.  After a failed steal, wait a
+    // tick before trying again.
+    acquire(&rq->lock);
+    idle = rq->nqueued == 0;
+    release(&rq->lock);
+    if(idle && ticks - rq->lastbalance < BALANCETICKS &&
+       (busiest_rq(rq) == 0 || rq->lastfail == ticks)){
+      halt(rq);
+      continue;
     }
 
-    // choose process to run(with min vruntime)
-    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
-      if (p->state == RUNNABLE){
-        if (p->vruntime == 0 && p->overflow_times == 0)
-        {
-          is_there_min_proc = 1;
-          min_vrun_proc = p;
-          break;
-        }
-        if (
-          p->overflow_times < min_overflow_times ||
-          (p->vruntime < min_vruntime && p->overflow_times == min_overflow_times)
-        )
-        {
-          is_there_min_proc = 1;
-          min_vruntime = p->vruntime;
-          min_overflow_times = p->overflow_times;
-          min_vrun_proc = p;
-        }
-      }
+    if(ticks - rq->lastbalance >= BALANCETICKS)
+      balance(rq);
+    if(rq->nqueued == 0)
+      steal(rq);
 
-    // Switch to chosen process.  It is the process's job
-    // to release ptable.lock and then reacquire it
-    // before jumping back to us.
-    if (!is_there_min_proc){
-      release(&ptable.lock);
+    // Choose the process with the smallest vruntime; its time
+    // slice is its share of the load of this CPU.
+    acquire(&rq->lock);
+    if(rq->tree.leftmost == 0){
+      release(&rq->lock);
       continue;
     }
+    p = rb_proc(rq->tree.leftmost);
+    p->time_slice = divu64((uint64)TICKNS*10*weight_table[p->nice], rq->load);
+    p->cur_runtime = 0;
+    dequeue(rq, p);
+    rq->curr = p;
 
-    c->proc = min_vrun_proc;
-    min_vrun_proc->state = RUNNING;
-    switchuvm(min_vrun_proc);
+    // Switch to chosen process.  It is the process's job
+    // to release rq->lock and then reacquire it
+    // before jumping back to us.
+    c->proc = p;
+    p->state = RUNNING;
+    switchuvm(p);
 
-    swtch(&(c->scheduler), min_vrun_proc->context);
+    p->execstart = rdtsc();
+    timerset(p->time_slice);
+    swtch(&(c->scheduler), p->context);
     switchkvm();
+    update_runtime(p);
 
     // Process is done running for now.
     // It should have changed its p->state before coming back.
+    // If it yielded, it goes back in the tree; otherwise it
+    // has left this CPU.
     c->proc = 0;
-
-    release(&ptable.lock);
+    rq->curr = 0;
+    p->lastran = ticks;
+    if(p->state == RUNNABLE)
+      enqueue(rq, p);
+    else
+      rq->load -= weight_table[p->nice];
+    update_min_vruntime(rq);
+    release(&rq->lock);
   }
 }
 
-// Enter scheduler.  Must hold only ptable.lock
-// and have changed proc->state. Saves and restores
+// Charge p, running on this CPU, for the time since
+// p->execstart, as measured by the time stamp counter.
+void
+update_runtime(struct proc *p)
+{
+  uint64 now, delta;
+
+  now = rdtsc();
+  delta = tsc2ns(now - p->execstart);
+  p->execstart = now;
+  p->runtime += delta;
+  p->cur_runtime += delta;
+  p->vruntime += divu64(delta*1024, weight_table[p->nice]);
+}
+
+// Enter scheduler.  Must hold only the lock of this
+// CPU's runqueue and have changed proc->state. Saves and restores
 // intena because intena is a property of this
 // kernel thread, not this CPU. It should
 // be proc->intena and proc->ncli, but that would
@@ -436,8 +857,8 @@ sched(void)
   int intena;
   struct proc *p = myproc();
 
-  if(!holding(&ptable.lock))
-    panic("sched ptable.lock"); // panic: 치명적 요류 떴을때라 함
+  if(!holding(&rq_of(p)->lock))
+    panic("sched rq->lock"); // panic: 치명적 요류 떴을때라 함
   if(mycpu()->ncli != 1) // ncli: 인터럽트가 비활성화된 횟수
     panic("sched locks");
   if(p->state == RUNNING)
@@ -449,14 +870,17 @@ sched(void)
   mycpu()->intena = intena;
 }
 
-// Give up the CPU for one scheduling round.
+// Give up the CPU for one scheduling round.  The lock
+// released is that of the runqueue it runs on next.
 void
 yield(void)
 {
-  acquire(&ptable.lock);  //DOC: yieldlock
-  myproc()->state = RUNNABLE;
+  struct proc *p = myproc();
+
+  acquire(&rq_of(p)->lock);  //DOC: yieldlock
+  p->state = RUNNABLE;
   sched();
-  release(&ptable.lock);
+  release(&rq_of(p)->lock);
 }
 
 // A fork child's very first scheduling by scheduler()
@@ -465,8 +889,8 @@ void
 forkret(void)
 {
   static int first = 1;
-  // Still holding ptable.lock from scheduler.
-  release(&ptable.lock);
+  // Still holding rq->lock from scheduler.
+  release(&rq_of(myproc())->lock);
 
   if (first) {
     // Some initialization functions must be run in the context
@@ -486,6 +910,7 @@ void
 sleep(void *chan, struct spinlock *lk)
 {
   struct proc *p = myproc();
+  struct sleepq *q = sleepq(chan);
   
   if(p == 0)
     panic("sleep");
@@ -493,107 +918,50 @@ sleep(void *chan, struct spinlock *lk)
   if(lk == 0)
     panic("sleep without lk");
 
-  // Must acquire ptable.lock in order to
-  // change p->state and then call sched.
-  // Once we hold ptable.lock, we can be
-  // guaranteed that we won't miss any wakeup
-  // (wakeup runs with ptable.lock locked),
-  // so it's okay to release lk.
-  if(lk != &ptable.lock){  //DOC: sleeplock0
-    acquire(&ptable.lock);  //DOC: sleeplock1
-    release(lk);
-  }
-  // Go to sleep.
+  // Once we hold q->lock, we can be guaranteed that
+  // we won't miss any wakeup (wakeup runs with q->lock
+  // locked), so it's okay to release lk.
+  acquire(&q->lock);  //DOC: sleeplock1
+  release(lk);
+
+  // Go to sleep.  Our runqueue lock, held until the
+  // scheduler has switched away, keeps a wakeup from
+  // making us RUNNABLE before then.
   p->chan = chan;
+  p->qnext = q->head;
+  q->head = p;
+  acquire(&rq_of(p)->lock);
   p->state = SLEEPING;
+  release(&q->lock);
 
   sched();
 
   // Tidy up.
+  release(&rq_of(p)->lock);
   p->chan = 0;
 
   // Reacquire original lock.
-  if(lk != &ptable.lock){  //DOC: sleeplock2
-    release(&ptable.lock);
-    acquire(lk);
-  }
+  acquire(lk);  //DOC: sleeplock2
 }
 
 //PAGEBREAK!
-// Wake up all processes sleeping on chan.
-// The ptable lock must be held.
-static void
-wakeup1(void *chan)
-{
-  struct proc *p;
-  // 고친부분
-  
-  struct proc *min_vrun_proc = 0;
-  int is_there_runable = 0; // runable 존재하는지
-  unsigned int min_vruntime = (unsigned int) -1;
-  unsigned int min_overflow_times = (unsigned int) -1;
-
-  // choose process min process(with min vruntime)
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
-    if (p->state == RUNNABLE){
-      if (p->vruntime == 0 && p->overflow_times == 0)
-      {
-        is_there_runable = 1;
-        min_vrun_proc = p;
-        break;
-      }
-      if (
-        p->overflow_times < min_overflow_times ||
-        (p->vruntime < min_vruntime && p->overflow_times == min_overflow_times)
-      )
-      {
-        is_there_runable = 1;
-        min_vruntime = p->vruntime;
-        min_overflow_times = p->overflow_times;
-        min_vrun_proc = p;
-      }
-    }
-
-
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
-    if(p->state == SLEEPING && p->chan == chan)
-    {
-      p->state = RUNNABLE;
-      if(is_there_runable)
-      {
-        unsigned int one_tick_minus = 1000*1024/weight_table[myproc()->nice];
-        
-        if(min_vrun_proc->vruntime >= one_tick_minus)
-        {
-          p->overflow_times = min_vrun_proc->overflow_times;
-          p->vruntime = min_vrun_proc->vruntime - one_tick_minus;
-        }
-        else if(min_vrun_proc->overflow_times)
-        {
-          p->overflow_times = min_vrun_proc->overflow_times - 1;
-          p->vruntime = ((unsigned int) -1) - one_tick_minus + min_vrun_proc->vruntime; 
-        }
-        else 
-        {
-          p->overflow_times = 0;
-          p->vruntime = 0;
-        }
-      }
-      else
-      {
-        p->overflow_times = 0;
-        p->vruntime = 0;
-      }
-    }
-}
-
 // Wake up all processes sleeping on chan.
 void
 wakeup(void *chan)
 {
-  acquire(&ptable.lock);
-  wakeup1(chan);
-  release(&ptable.lock);
+  struct sleepq *q = sleepq(chan);
+  struct proc *p, **pp;
+
+  acquire(&q->lock);
+  pp = &q->head;
+  while((p = *pp) != 0){
+    if(p->chan == chan){
+      *pp = p->qnext;
+      activate(p);
+    } else
+      pp = &p->qnext;
+  }
+  release(&q->lock);
 }
 
 // Kill the process with the given pid.
@@ -602,75 +970,31 @@ wakeup(void *chan)
 int
 kill(int pid)
 {
-  struct proc *p;
+  struct proc *p, **pp;
+  struct sleepq *q;
+  void *chan;
 
   acquire(&ptable.lock);
-  
-  struct proc *min_vrun_proc = 0;
-  int is_there_runable = 0; // runable 존재하는지
-  unsigned int min_vruntime = (unsigned int) -1;
-  unsigned int min_overflow_times = (unsigned int) -1;
-
-  // choose process min process(with min vruntime)
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
-    if (p->state == RUNNABLE){
-      if (p->vruntime == 0 && p->overflow_times == 0)
-      {
-        is_there_runable = 1;
-        min_vrun_proc = p;
-        break;
-      }
-      if (
-        p->overflow_times < min_overflow_times ||
-        (p->vruntime < min_vruntime && p->overflow_times == min_overflow_times)
-      )
-      {
-        is_there_runable = 1;
-        min_vruntime = p->vruntime;
-        min_overflow_times = p->overflow_times;
-        min_vrun_proc = p;
-      }
-    }
-
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-    if(p->pid == pid){
-      p->killed = 1;
-      // Wake process from sleep if necessary.
-      if(p->state == SLEEPING)
-      {
-        p->state = RUNNABLE;
-        if(is_there_runable)
-        {
-          unsigned int one_tick_minus = 1000*1024/weight_table[myproc()->nice];
-
-          if(min_vrun_proc->vruntime >= one_tick_minus)
-          {
-            p->overflow_times = min_vrun_proc->overflow_times;
-            p->vruntime = min_vrun_proc->vruntime - one_tick_minus;
-          }
-          else if(min_vrun_proc->overflow_times)
-          {
-            p->overflow_times = min_vrun_proc->overflow_times - 1;
-            p->vruntime = ((unsigned int) -1) - one_tick_minus + min_vrun_proc->vruntime; 
-          }
-          else
-          {
-            p->overflow_times = 0;
-            p->vruntime = 0;
-          }
-        }
-        else
-        {
-          p->overflow_times = 0;
-          p->vruntime = 0;
-        }
-      }
-      release(&ptable.lock);
-      return 0;
-    }
+  if((p = findproc(pid)) == 0){
+    release(&ptable.lock);
+    return -1;
+  }
+  p->killed = 1;
+  // Wake process from sleep if necessary.  It may be
+  // going to sleep or waking meanwhile; check again
+  // under the lock of the queue it would be on.
+  chan = p->chan;
+  q = sleepq(chan);
+  acquire(&q->lock);
+  if(p->state == SLEEPING && p->chan == chan){
+    for(pp = &q->head; *pp != p; pp = &(*pp)->qnext)
+      ;
+    *pp = p->qnext;
+    activate(p);
   }
+  release(&q->lock);
   release(&ptable.lock);
-  return -1;
+  return 0;
 }
 
 //PAGEBREAK: 36
@@ -693,7 +1017,7 @@ procdump(void)
   char *state;
   uint pc[10];
 
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+  for(p = ptable.all; p; p = p->allnext){
     if(p->state == UNUSED)
       continue;
     if(p->state >= 0 && p->state < NELEM(states) && states[p->state])
@@ -717,18 +1041,8 @@ getnice(int pid)
   acquire(&ptable.lock);
 
   int return_value = -1;
-  for(
-    p = ptable.proc;
-    p < &ptable.proc[NPROC];
-    p++
-  ){
-    if(
-      p->pid == pid
-    ){
-      return_value = p->nice;
-      break;
-    }
-  }
+  if((p = findproc(pid)) != 0)
+    return_value = p->nice;
   release(&ptable.lock);
   return return_value;
 }
@@ -742,41 +1056,21 @@ setnice(int pid, int value)
   }
 
   struct proc *p;
+  struct runqueue *rq;
   acquire(&ptable.lock);
-  for(
-    p = ptable.proc;
-    p < &ptable.proc[NPROC];
-    p++
-  ){
-    if(p->pid == pid){
-      p->nice = value;
-
-      return_value = 0;
-  
-      break;
-    }
+  if((p = findproc(pid)) != 0){
+    rq = lock_rq_of(p);
+    if(p->state == RUNNABLE || p->state == RUNNING)
+      rq->load += weight_table[value] - weight_table[p->nice];
+    p->nice = value;
+    release(&rq->lock);
+
+    return_value = 0;
   }
   release(&ptable.lock);
   return return_value;
 }
 
-void itoiarr(unsigned int num, int *iarr) {
-    int i = 0;
-    do {
-        iarr[i] = (num % 10);
-        i += 1;
-        num = num / 10;
-    } while (
-      num > 0
-    );
-
-    for (int j = i; j<20; j++) 
-    {
-      iarr[j] = 0;
-    }
-    
-}
-
 void print_int(
   int num,
   int max_len
@@ -800,29 +1094,6 @@ void print_int(
   }
 }
 
-void print_unsigned(
-  unsigned int num,
-  int max_len
-)
-{
-  cprintf("%d", num);
-  
-  int num_len = 0;
-  if (num)
-  {
-    while (num != 0) {
-      num = num / 10;
-      num_len++;
-    }
-  }
-  else num_len = 1;
-  
-  for(int left=0; left < max_len - num_len; left++)
-  { 
-    cprintf(" ");
-  }
-}
-
 void print_string(
   char* string,
   int max_len
@@ -842,59 +1113,22 @@ void print_string(
   }
 }
 
-void print_vruntime(
-  unsigned int overflow_num,
-  unsigned int vruntime_num
-){
-  if (overflow_num){
-    int output_number[20] = {0};
-
-    int carry = 0;
-    // overflow part
-    for (int overflow_idx = 0; overflow_idx<overflow_num; overflow_idx++){
-      int to_iarr[20];
-      unsigned int overflowed = (unsigned int) -1;
-      itoiarr(overflowed, to_iarr);
-
-      for (int idx = 0; idx < 20; idx++){
-        int result = to_iarr[idx] + output_number[idx] + carry;
-        output_number[idx] = (
-          result
-        ) % 10;
-        if (result >= 10) carry = 1;
-        else carry = 0;
-      }
-    }
-    // Leftover part
-    int to_iarr[20];
-    itoiarr(vruntime_num, to_iarr);
-
-    carry = 0;
-
-    for (int idx = 0; idx < 20; idx++){
-      int result = to_iarr[idx] + output_number[idx] + carry;
-      output_number[idx] = (
-        result
-      ) % 10;
-      if (result >= 10) carry = 1;
-      else carry = 0;
-    }
+void print_unsigned(
+  uint64 num,
+  int max_len
+)
+{
+  char buf[21];
+  int i = sizeof(buf) - 1;
 
-    int start = 0;
+  buf[i] = '\0';
+  do {
+    uint64 q = divu64(num, 10);
+    buf[--i] = '0' + (num - q*10);
+    num = q;
+  } while (num != 0);
 
-    for (int idx = 19; idx >= 0; idx--){
-      if (!start && output_number[idx] != 0){
-        start = 1;
-      }
-      if (start){
-        cprintf("%d", output_number[idx]);
-      }
-    }
-  }
-  else{
-    cprintf("%d", vruntime_num);
-  }
-  cprintf("\n");
+  print_string(buf + i, max_len);
 }
 
 
@@ -910,44 +1144,41 @@ void ps(int pid){
   print_string("runtime/weight", 20);
   print_string("runtime", 20);
   print_string("vruntime", 20);
-  cprintf("tick %d\n", ticks*1000);
+  cprintf("tick ");
+  print_unsigned((uint64)ticks*TICKNS, 0);
+  cprintf("\n");
 
   if(pid){
-    for(
-      p = ptable.proc;
-      p <= &ptable.proc[NPROC];
-      p++
-    ){
-      if(p->pid == pid){
-        if(p->state != 0 && p->state <= 5){
-          print_string(p->name, 10);
-          print_int(p->pid, 10);
-          print_string(states_by_idx[p->state], 20);
-          print_int(p->nice, 20);
-          print_unsigned(p->runtime/weight_table[p->nice], 20);
-          print_unsigned(p->runtime, 20);
-          print_vruntime(p->overflow_times, p->vruntime);
-        }
-        break;
-      }
+    if((p = findproc(pid)) != 0){
+      print_string(p->name, 10);
+      print_int(p->pid, 10);
+      print_string(states_by_idx[p->state], 20);
+      print_int(p->nice, 20);
+      print_unsigned(divu64(p->runtime, weight_table[p->nice]), 20);
+      print_unsigned(p->runtime, 20);
+      print_unsigned(p->vruntime, 0);
+      cprintf("\n");
     }
   }
   else{
-    for(
-      p = ptable.proc;
-      p <= &ptable.proc[NPROC];
-      p++
-    ){
+    for(p = ptable.all; p; p = p->allnext){
       if(p->state != 0 && p->state <= 5 && p->pid >= 0){
         print_string(p->name, 10);
         print_int(p->pid, 10);
         print_string(states_by_idx[p->state], 20);
         print_int(p->nice, 10);
-        print_unsigned(p->runtime/weight_table[p->nice], 20);
+        print_unsigned(divu64(p->runtime, weight_table[p->nice]), 20);
         print_unsigned(p->runtime, 20);
-        print_vruntime(p->overflow_times, p->vruntime);
+        print_unsigned(p->vruntime, 0);
+        cprintf("\n");
       }
     }
+
+    // Per-CPU runqueues and how often idle CPUs stole work.
+    for(int i = 0; i < ncpu; i++)
+      cprintf("cpu %d: queued %d load %d steals %d failed %d\n", i,
+              runqueues[i].nqueued, runqueues[i].load,
+              runqueues[i].steals, runqueues[i].failed_steals);
   }
   
   release(&ptable.lock);
@@ -32,6 +32,19 @@ struct context {
   uint eip;
 };
 
+// Red-black tree node, embedded in what the tree orders (see rbtree.c).
+struct rb_node {
+  struct rb_node *parent;
+  struct rb_node *left;
+  struct rb_node *right;
+  int red;
+};
+
+struct rb_root {
+  struct rb_node *node;        // Root of the tree, or null
+  struct rb_node *leftmost;    // Smallest node, or null
+};
+
 enum procstate { UNUSED, EMBRYO, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
 // Per-process state
@@ -45,16 +58,24 @@ struct proc {
   struct trapframe *tf;        // Trap frame for current syscall
   struct context *context;     // swtch() here to run process
   void *chan;                  // If non-zero, sleeping on chan
+  struct proc *qnext;          // Next in chan's sleep queue, or free
+  struct proc *pidnext;        // Next with the same pid hash
+  struct proc *allnext;        // Next in the whole process table
+  uint64 deadline;             // TSC to wake at in nsleep(), or 0
+  struct rb_node hrnode;       // In the timer tree while deadline != 0
   int killed;                  // If non-zero, have been killed
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
   int nice;
-  unsigned int vruntime;
-  unsigned int runtime;
-  unsigned int cur_runtime;
-  unsigned int overflow_times;
-  unsigned int time_slice;
+  uint64 vruntime;             // Weighted run time, in ns
+  uint64 runtime;              // Run time, in ns
+  uint64 cur_runtime;          // Run time since last scheduled, in ns
+  uint64 time_slice;           // Run time this turn may take, in ns
+  uint64 execstart;            // TSC when last charged for running
+  int cpu;                     // CPU whose runqueue it is on
+  uint lastran;                // ticks when it last stopped running
+  struct rb_node rb;           // In the runqueue while RUNNABLE
 };
 
 // Process memory is laid out contiguously, low addresses first:
@@ -0,0 +1,244 @@
+// Red-black trees.
+//
+// Nodes are embedded in the structures they order.  The caller
+// walks down from root->node to find where a new node belongs and
+// passes that link to rb_insert(), which rebalances.  The root
+// caches its leftmost node, so the smallest one is found in O(1).
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "proc.h"
+
+static void
+rotate_left(struct rb_root *root, struct rb_node *x)
+{
+  struct rb_node *y = x->right;
+
+  x->right = y->left;
+  if(y->left)
+    y->left->parent = x;
+  y->parent = x->parent;
+  if(x->parent == 0)
+    root->node = y;
+  else if(x == x->parent->left)
+    x->parent->left = y;
+  else
+    x->parent->right = y;
+  y->left = x;
+  x->parent = y;
+}
+
+static void
+rotate_right(struct rb_root *root, struct rb_node *x)
+{
+  struct rb_node *y = x->left;
+
+  x->left = y->right;
+  if(y->right)
+    y->right->parent = x;
+  y->parent = x->parent;
+  if(x->parent == 0)
+    root->node = y;
+  else if(x == x->parent->right)
+    x->parent->right = y;
+  else
+    x->parent->left = y;
+  y->right = x;
+  x->parent = y;
+}
+
+static int
+isred(struct rb_node *n)
+{
+  return n && n->red;
+}
+
+// Link node in at *link, a null child pointer of parent (or
+// root->node if parent is 0), and rebalance.  leftmost says whether
+// the way down to link only went left.
+void
+rb_insert(struct rb_root *root, struct rb_node *node,
+          struct rb_node *parent, struct rb_node **link, int leftmost)
+{
+  struct rb_node *g, *u;
+
+  node->parent = parent;
+  node->left = node->right = 0;
+  node->red = 1;
+  *link = node;
+  if(leftmost)
+    root->leftmost = node;
+
+  while((parent = node->parent) && parent->red){
+    g = parent->parent;  // the root is black, so parent is not it
+    if(parent == g->left){
+      u = g->right;
+      if(isred(u)){
+        parent->red = u->red = 0;
+        g->red = 1;
+        node = g;
+        continue;
+      }
+      if(node == parent->right){
+        rotate_left(root, parent);
+        node = parent;
+        parent = node->parent;
+      }
+      parent->red = 0;
+      g->red = 1;
+      rotate_right(root, g);
+    } else {
+      u = g->left;
+      if(isred(u)){
+        parent->red = u->red = 0;
+        g->red = 1;
+        node = g;
+        continue;
+      }
+      if(node == parent->left){
+        rotate_right(root, parent);
+        node = parent;
+        parent = node->parent;
+      }
+      parent->red = 0;
+      g->red = 1;
+      rotate_left(root, g);
+    }
+  }
+  root->node->red = 0;
+}
+
+// The node after n in order, or 0.
+struct rb_node*
+rb_next(struct rb_node *n)
+{
+  if(n->right){
+    for(n = n->right; n->left; n = n->left)
+      ;
+    return n;
+  }
+  while(n->parent && n == n->parent->right)
+    n = n->parent;
+  return n->parent;
+}
+
+// Put v, or nothing, in u's place under u's parent.
+static void
+transplant(struct rb_root *root, struct rb_node *u, struct rb_node *v)
+{
+  if(u->parent == 0)
+    root->node = v;
+  else if(u == u->parent->left)
+    u->parent->left = v;
+  else
+    u->parent->right = v;
+  if(v)
+    v->parent = u->parent;
+}
+
+// Restore the black heights after a black node was taken out
+// from under p, leaving x, maybe null, in its place.
+static void
+erase_fixup(struct rb_root *root, struct rb_node *x, struct rb_node *p)
+{
+  struct rb_node *w;
+
+  while(x != root->node && !isred(x)){
+    if(x == p->left){
+      w = p->right;
+      if(w->red){
+        w->red = 0;
+        p->red = 1;
+        rotate_left(root, p);
+        w = p->right;
+      }
+      if(!isred(w->left) && !isred(w->right)){
+        w->red = 1;
+        x = p;
+        p = x->parent;
+        continue;
+      }
+      if(!isred(w->right)){
+        w->left->red = 0;
+        w->red = 1;
+        rotate_right(root, w);
+        w = p->right;
+      }
+      w->red = p->red;
+      p->red = 0;
+      w->right->red = 0;
+      rotate_left(root, p);
+    } else {
+      w = p->left;
+      if(w->red){
+        w->red = 0;
+        p->red = 1;
+        rotate_right(root, p);
+        w = p->left;
+      }
+      if(!isred(w->left) && !isred(w->right)){
+        w->red = 1;
+        x = p;
+        p = x->parent;
+        continue;
+      }
+      if(!isred(w->left)){
+        w->right->red = 0;
+        w->red = 1;
+        rotate_left(root, w);
+        w = p->left;
+      }
+      w->red = p->red;
+      p->red = 0;
+      w->left->red = 0;
+      rotate_right(root, p);
+    }
+    x = root->node;
+  }
+  if(x)
+    x->red = 0;
+}
+
+// Take z out of the tree.
+void
+rb_erase(struct rb_root *root, struct rb_node *z)
+{
+  struct rb_node *x, *p, *y;
+  int red;
+
+  if(root->leftmost == z)
+    root->leftmost = rb_next(z);
+
+  red = z->red;
+  if(z->left == 0){
+    x = z->right;
+    p = z->parent;
+    transplant(root, z, x);
+  } else if(z->right == 0){
+    x = z->left;
+    p = z->parent;
+    transplant(root, z, x);
+  } else {
+    // Replace z by its successor y, the leftmost of its right subtree.
+    for(y = z->right; y->left; y = y->left)
+      ;
+    red = y->red;
+    x = y->right;
+    if(y->parent == z)
+      p = y;
+    else {
+      p = y->parent;
+      transplant(root, y, x);
+      y->right = z->right;
+      y->right->parent = y;
+    }
+    transplant(root, z, y);
+    y->left = z->left;
+    y->left->parent = y;
+    y->red = z->red;
+  }
+  if(!red)
+    erase_fixup(root, x, p);
+}
@@ -23,3 +23,4 @@
 #define SYS_getnice 22
 #define SYS_setnice 23
 #define SYS_ps 24
+#define SYS_nanosleep 25
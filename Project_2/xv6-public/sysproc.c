@@ -60,21 +60,10 @@ int
 sys_sleep(void)
 {
   int n;
-  uint ticks0;
 
-  if(argint(0, &n) < 0)
+  if(argint(0, &n) < 0 || n < 0)
     return -1;
-  acquire(&tickslock);
-  ticks0 = ticks;
-  while(ticks - ticks0 < n){
-    if(myproc()->killed){
-      release(&tickslock);
-      return -1;
-    }
-    sleep(&ticks, &tickslock);
-  }
-  release(&tickslock);
-  return 0;
+  return nsleep((uint64)n * TICKNS);
 }
 
 // return how many clock tick interrupts have occurred
@@ -130,3 +119,15 @@ sys_ps(void)
     return 0;
   }
 }
+
+int
+sys_nanosleep(void)
+{
+  int sec, nsec;
+
+  if(argint(0, &sec) < 0 || argint(1, &nsec) < 0)
+    return -1;
+  if(sec < 0 || nsec < 0 || nsec >= 1000000000)
+    return -1;
+  return nsleep((uint64)sec * 1000000000 + nsec);
+}
@@ -14,18 +14,6 @@ extern uint vectors[];  // in vectors.S: array of 256 entry pointers
 struct spinlock tickslock;
 uint ticks;
 
-int weights[40] = 
-{
-  88761,  71755,  56483,  46273,  36291,
-  29154,  23254,  18705,  14949,  11916,
-  9548,   7620,   6100,   4904,   3906,
-  3121,   2501,   1991,   1586,   1277,
-  1024,   820,    655,    526,    423,
-  335,    272,    215,    172,    137,
-  110,    87,     70,     56,     45,
-  36,     29,     23,     18,     15
-};
-
 void
 tvinit(void)
 {
@@ -60,12 +48,17 @@ trap(struct trapframe *tf)
 
   switch(tf->trapno){
   case T_IRQ0 + IRQ_TIMER:
-    if(cpuid() == 0){
+    // The timer is one-shot: it may have fired for CPU 0's
+    // tick, for the end of a time slice, for a sleeper's
+    // deadline, or for any of these at once.
+    if(cpuid() == 0 && tickdue()){
       acquire(&tickslock);
       ticks++;
-      wakeup(&ticks);
       release(&tickslock);
     }
+    hrtimer_expire();
+    if(myproc() == 0)
+      timerset(0);
     lapiceoi();
     break;
   case T_IRQ0 + IRQ_IDE:
@@ -75,6 +68,10 @@ trap(struct trapframe *tf)
   case T_IRQ0 + IRQ_IDE+1:
     // Bochs generates spurious IDE1 interrupts.
     break;
+  case T_IRQ0 + IRQ_WAKEUP:
+    // Only to end a hlt; the scheduler loop looks for work.
+    lapiceoi();
+    break;
   case T_IRQ0 + IRQ_KBD:
     kbdintr();
     lapiceoi();
@@ -115,35 +112,16 @@ trap(struct trapframe *tf)
   // Force process to give up CPU on clock tick.
   // If interrupts were on while locks held, would need to check nlock.
 
-  // Increase cur_running and running and vruntime every time slice
+  // Charge the running process for the time it has run, and
+  // preempt it once it has used up its time slice.
   if(myproc() && myproc()->state == RUNNING &&
      tf->trapno == T_IRQ0+IRQ_TIMER)
   {
-    myproc()->cur_runtime += 1000;
-    myproc()->runtime += 1000;
-
-    unsigned int result = 1000*1024/weights[myproc()->nice];
-
-    // Overflow detection
-    if (4294967295 - myproc()->vruntime < result)
-    {
-      unsigned int limit = (unsigned int) -1;
-
-      unsigned int leftover = (unsigned int) result - (limit-(myproc()->vruntime));
-      myproc()->overflow_times += 1;
-      myproc()->vruntime = leftover;
-    }
-    else{
-      myproc()->vruntime += (unsigned int) result;
-    }
-
-    // Every tick -> check if time slice is done -> if done ? yeild and reset.
+    update_runtime(myproc());
     if (myproc()->cur_runtime >= myproc()->time_slice)
-    {
-      myproc()->cur_runtime = 0;
       yield();
-    }
-
+    else
+      timerset(myproc()->time_slice - myproc()->cur_runtime);
   }
 
   // Check if the process has been killed since we yielded
@@ -26,6 +26,7 @@ int uptime(void);
 int getnice(int);
 int setnice(int, int);
 void ps(int);
+int nanosleep(int, int);
 
 // ulib.c
 int stat(const char*, struct stat*);
@@ -117,6 +117,15 @@ sti(void)
   asm volatile("sti");
 }
 
+// Enable interrupts and wait for one.  sti takes effect only
+// after the next instruction, so an interrupt that is already
+// pending wakes the hlt rather than slipping in before it.
+static inline void
+sti_hlt(void)
+{
+  asm volatile("sti; hlt");
+}
+
 static inline uint
 xchg(volatile uint *addr, uint newval)
 {
@@ -144,6 +153,26 @@ lcr3(uint val)
   asm volatile("movl %0,%%cr3" : : "r" (val));
 }
 
+static inline uint64
+rdtsc(void)
+{
+  uint64 val;
+  asm volatile("rdtsc" : "=A" (val));
+  return val;
+}
+
+// n / d without libgcc's 64-bit division.
+static inline uint64
+divu64(uint64 n, uint d)
+{
+  uint hi, lo, r;
+
+  hi = n >> 32;
+  r = hi % d;
+  asm volatile("divl %4" : "=a" (lo), "=d" (r) : "a" ((uint)n), "d" (r), "rm" (d));
+  return (uint64)(hi / d) << 32 | lo;
+}
+
 //PAGEBREAK: 36
 // Layout of the trap frame built on the stack by the
 // hardware and by trapasm.S, and passed to trap().
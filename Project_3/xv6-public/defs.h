@@ -185,6 +185,10 @@ pde_t*          setupkvm(void);
 char*           uva2ka(pde_t*, char*);
 int             allocuvm(pde_t*, uint, uint);
 int             deallocuvm(pde_t*, uint, uint);
+int             zerouvm(pde_t*, uint, uint);
+int             iszeropage(uint);
+int             mapzero(pde_t*, char*);
+int             zerofault(pde_t*, uint);
 void            freevm(pde_t*);
 void            inituvm(pde_t*, char*, uint);
 int             loaduvm(pde_t*, char*, struct inode*, uint, uint);
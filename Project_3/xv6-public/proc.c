@@ -193,7 +193,7 @@ growproc(int n)
 
   sz = curproc->sz;
   if(n > 0){
-    if((sz = allocuvm(curproc->pgdir, sz, sz + n)) == 0)
+    if((sz = zerouvm(curproc->pgdir, sz, sz + n)) == 0)
       return -1;
   } else if(n < 0){
     if((sz = deallocuvm(curproc->pgdir, sz, sz + n)) == 0)
@@ -333,7 +333,9 @@ fork(void)
             char is_file_mapping = parent_area->flags%2==0;
             char is_already_allocated = (parent_area->mark=='a');
 
-            if (is_already_allocated){
+            // The child's anonymous pages would be zero anyway;
+            // let it fault them in as it touches them.
+            if (is_already_allocated && is_file_mapping){
               int page_size = 4096;
 
               char *memory_pointer = NULL;
@@ -1283,12 +1285,12 @@ int munmap(unsigned int addr){
       myproc()->pgdir,
       (char *)(addr+count*page_size), 0
     );
-    if((*page_table_entry%2)){
-      if (page_table_entry){
+    // Anonymous mappings are faulted in a page at a time, so any
+    // of their pages may be missing or still the zero page.
+    if(page_table_entry && (*page_table_entry%2)){
+      if(!iszeropage(PTE_ADDR(*page_table_entry)))
         kfree(P2V(PTE_ADDR(*page_table_entry)));
-        *page_table_entry = !(*page_table_entry%2);
-      }
-      else return return_value;
+      *page_table_entry = 0;
     }
     else{
       continue;
@@ -1339,6 +1341,9 @@ int pagefault_handle(
   //cprintf("Page handler found idx: %d\n", temp);
 
   if(!(temp < 64)){
+    // Not mmap()ed, but it may be a write to the zero page in the heap.
+    if(err_2place_bit && curproc && address < curproc->sz)
+      return zerofault(curproc->pgdir, address);
     return return_value;
   }
   else{
@@ -1352,6 +1357,41 @@ int pagefault_handle(
     ) 
   ) return return_value;
 
+  // Anonymous mapping: fault in just this page.  A read maps the
+  // shared zero page; a write, to it or to a missing page, gets a
+  // zeroed page of its own.
+  if(mmap_area_list[idx].flags%2){
+    unsigned int page_addr = PGROUNDDOWN(address);
+    unsigned int *page_table_entry = walkpgdir(
+      curproc->pgdir, (char *)page_addr, 0
+    );
+
+    if(page_table_entry && (*page_table_entry%2))
+      return zerofault(curproc->pgdir, page_addr);
+
+    if(!err_2place_bit){
+      if(mapzero(curproc->pgdir, (char *)page_addr) < 0)
+        return return_value;
+    }
+    else{
+      char *memory_pointer = kalloc();
+      if(!memory_pointer)
+        return return_value;
+      memset(memory_pointer, 0, page_size);
+
+      char is_usermode = 1;
+      if(mappages(
+        curproc->pgdir, (void*)page_addr, page_size,
+        V2P(memory_pointer), mmap_area_list[idx].prot, is_usermode
+      ) < 0){
+        kfree(memory_pointer);
+        return return_value;
+      }
+    }
+    mmap_area_list[idx].mark = 'a';
+    return 0;
+  }
+
   if(
     mmap_area_list[idx].mark == 'n'
   ){
@@ -10,6 +10,11 @@
 extern char data[];  // defined by kernel.ld
 pde_t *kpgdir;  // for use in scheduler()
 
+// The shared zero page.  Untouched anonymous memory, in the heap and
+// in anonymous mmap() regions, maps it read-only; the first write
+// gives the process a page of its own (see zerofault()).
+static char zeropage[PGSIZE] __attribute__((aligned(PGSIZE)));
+
 // Set up CPU's kernel segment descriptors.
 // Run once on entry on each CPU.
 void
@@ -252,6 +257,64 @@ allocuvm(pde_t *pgdir, uint oldsz, uint newsz)
   return newsz;
 }
 
+// Grow process from oldsz to newsz like allocuvm(), but map the new
+// pages to the zero page, so that memory is only allocated for the
+// ones that get written.  Returns new size or 0 on error.
+int
+zerouvm(pde_t *pgdir, uint oldsz, uint newsz)
+{
+  uint a;
+
+  if(newsz >= KERNBASE)
+    return 0;
+  if(newsz < oldsz)
+    return oldsz;
+
+  a = PGROUNDUP(oldsz);
+  for(; a < newsz; a += PGSIZE){
+    if(mapzero(pgdir, (char*)a) < 0){
+      cprintf("zerouvm out of memory\n");
+      deallocuvm(pgdir, newsz, oldsz);
+      return 0;
+    }
+  }
+  return newsz;
+}
+
+int
+iszeropage(uint pa)
+{
+  return pa == V2P(zeropage);
+}
+
+// Map the zero page read-only at va.
+int
+mapzero(pde_t *pgdir, char *va)
+{
+  return mappages(pgdir, va, PGSIZE, V2P(zeropage), PTE_U, 0);
+}
+
+// Replace the zero page mapped at va with a zeroed page of the
+// process's own, on a write to it.  Returns -1 if va does not map
+// the zero page or there is no memory.
+int
+zerofault(pde_t *pgdir, uint va)
+{
+  pte_t *pte;
+  char *mem;
+
+  pte = walkpgdir(pgdir, (char*)PGROUNDDOWN(va), 0);
+  if(pte == 0 || (*pte & PTE_P) == 0 || !iszeropage(PTE_ADDR(*pte)))
+    return -1;
+  if((mem = kalloc()) == 0)
+    return -1;
+  memset(mem, 0, PGSIZE);
+  *pte = V2P(mem) | PTE_FLAGS(*pte) | PTE_W;
+  if(myproc() && myproc()->pgdir == pgdir)
+    lcr3(V2P(pgdir));
+  return 0;
+}
+
 // Deallocate user pages to bring the process size from oldsz to
 // newsz.  oldsz and newsz need not be page-aligned, nor does newsz
 // need to be less than oldsz.  oldsz can be larger than the actual
@@ -275,7 +338,8 @@ deallocuvm(pde_t *pgdir, uint oldsz, uint newsz)
       if(pa == 0)
         panic("kfree");
       char *v = P2V(pa);
-      kfree(v);
+      if(!iszeropage(pa))
+        kfree(v);
       *pte = 0;
     }
   }
@@ -333,6 +397,11 @@ copyuvm(pde_t *pgdir, uint sz)
       panic("copyuvm: page not present");
     pa = PTE_ADDR(*pte);
     flags = PTE_FLAGS(*pte);
+    if(iszeropage(pa)){
+      if(mappages(d, (void*)i, PGSIZE, pa, flags, 0) < 0)
+        goto bad;
+      continue;
+    }
     if((mem = kalloc()) == 0)
       goto bad;
     memmove(mem, (char*)P2V(pa), PGSIZE);
@@ -360,6 +429,9 @@ uva2ka(pde_t *pgdir, char *uva)
     return 0;
   if((*pte & PTE_U) == 0)
     return 0;
+  // Callers write through the kernel mapping.
+  if(iszeropage(PTE_ADDR(*pte)) && zerofault(pgdir, (uint)uva) < 0)
+    return 0;
   return (char*)P2V(PTE_ADDR(*pte));
 }
 
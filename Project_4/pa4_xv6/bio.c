@@ -17,18 +17,35 @@
 // * B_VALID: the buffer data has been read from the disk.
 // * B_DIRTY: the buffer data has been modified
 //     and needs to be written to disk.
+//
+// The cache starts with NBUF buffers and, while memory is
+// plentiful, grows by a page of buffers on a miss that finds no
+// buffer to recycle, or that reads a block dropped lately.  Under memory
+// pressure the page reclaimer calls bshrink() to take back a page
+// whose buffers are all idle and clean.  Blocks dropped lately are
+// remembered in shadow[], so that reading one again counts as a
+// refault, which reclaim uses to weigh the buffer cache against
+// anonymous memory.
 
 #include "types.h"
 #include "defs.h"
 #include "param.h"
+#include "mmu.h"
 #include "spinlock.h"
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
 
+#define NBHASH   61
+#define NSHADOW  512
+#define BUFPERPG (PGSIZE / sizeof(struct buf))
+
 struct {
   struct spinlock lock;
   struct buf buf[NBUF];
+  struct buf *hash[NBHASH];  // cached blocks, through hnext
+  uint shadow[NSHADOW];      // keys of blocks dropped lately
+  int npages;                // pages of buffers besides buf[]
 
   // Linked list of all buffers, through prev/next.
   // head.next is most recently used.
@@ -55,18 +72,78 @@ binit(void)
   }
 }
 
+static struct buf**
+bucket(uint dev, uint blockno)
+{
+  return &bcache.hash[(dev*31 + blockno) % NBHASH];
+}
+
+// Shadow entry for a block; never 0, which marks an empty entry.
+static uint
+shadowkey(uint dev, uint blockno)
+{
+  return (dev << 28 | blockno) + 1;
+}
+
+// Forget the block in b, remembering it in shadow[] if it
+// had been read.
+static void
+bforget(struct buf *b)
+{
+  struct buf **pp;
+  uint key;
+
+  for(pp = bucket(b->dev, b->blockno); *pp; pp = &(*pp)->hnext){
+    if(*pp == b){
+      *pp = b->hnext;
+      break;
+    }
+  }
+  if(b->flags & B_VALID){
+    key = shadowkey(b->dev, b->blockno);
+    bcache.shadow[key % NSHADOW] = key;
+  }
+  b->flags = 0;
+}
+
+// Add a page of free buffers at the LRU end and return one
+// of them, or return 0 if memory is short.
+static struct buf*
+bgrow(void)
+{
+  struct buf *b;
+  char *page;
+  int i;
+
+  if((page = kalloc_cache()) == 0)
+    return 0;
+  memset(page, 0, PGSIZE);
+  for(i = 0; i < BUFPERPG; i++){
+    b = (struct buf*)page + i;
+    initsleeplock(&b->lock, "buffer");
+    b->next = &bcache.head;
+    b->prev = bcache.head.prev;
+    bcache.head.prev->next = b;
+    bcache.head.prev = b;
+  }
+  bcache.npages++;
+  return (struct buf*)page;
+}
+
 // Look through buffer cache for block on device dev.
 // If not found, allocate a buffer.
 // In either case, return locked buffer.
 static struct buf*
 bget(uint dev, uint blockno)
 {
-  struct buf *b;
+  struct buf *b, *nb;
+  uint key;
+  int refault, grow;
 
   acquire(&bcache.lock);
 
   // Is the block already cached?
-  for(b = bcache.head.next; b != &bcache.head; b = b->next){
+  for(b = *bucket(dev, blockno); b; b = b->hnext){
     if(b->dev == dev && b->blockno == blockno){
       b->refcnt++;
       release(&bcache.lock);
@@ -75,21 +152,39 @@ bget(uint dev, uint blockno)
     }
   }
 
-  // Not cached; recycle an unused buffer.
+  // Was it dropped lately?
+  key = shadowkey(dev, blockno);
+  refault = bcache.shadow[key % NSHADOW] == key;
+  if(refault)
+    bcache.shadow[key % NSHADOW] = 0;
+
+  // Not cached; recycle the least recently used unused buffer.
   // Even if refcnt==0, B_DIRTY indicates a buffer is in use
   // because log.c has modified it but not yet committed it.
-  for(b = bcache.head.prev; b != &bcache.head; b = b->prev){
-    if(b->refcnt == 0 && (b->flags & B_DIRTY) == 0) {
-      b->dev = dev;
-      b->blockno = blockno;
-      b->flags = 0;
-      b->refcnt = 1;
-      release(&bcache.lock);
-      acquiresleep(&b->lock);
-      return b;
-    }
-  }
-  panic("bget: no buffers");
+  for(b = bcache.head.prev; b != &bcache.head; b = b->prev)
+    if(b->refcnt == 0 && (b->flags & B_DIRTY) == 0)
+      break;
+  // Grow instead if there is none, or if it holds a block and this
+  // one is a refault: then the cache is too small for the blocks in
+  // use, and dropping another would only make it refault too.
+  grow = b == &bcache.head || (refault && (b->flags & B_VALID));
+  if(grow && (nb = bgrow()) != 0)
+    b = nb;
+  else if(b == &bcache.head)
+    panic("bget: no buffers");
+  else
+    bforget(b);
+  b->dev = dev;
+  b->blockno = blockno;
+  b->flags = 0;
+  b->refcnt = 1;
+  b->hnext = *bucket(dev, blockno);
+  *bucket(dev, blockno) = b;
+  release(&bcache.lock);
+  if(refault)
+    note_file_refault();
+  acquiresleep(&b->lock);
+  return b;
 }
 
 // Return a locked buf with the contents of the indicated block.
@@ -115,6 +210,31 @@ bwrite(struct buf *b)
   iderw(b);
 }
 
+// Read or write (if write is set) the block straight between the
+// disk and data, which holds BSIZE bytes, bypassing the cache.
+// For swap I/O: a swapped-out page is read back once at most, so
+// caching its blocks would only push file blocks out, and reading
+// one again would pass for a file refault.
+void
+bdirect(uint dev, uint blockno, void *data, int write)
+{
+  struct buf b;
+
+  memset(&b, 0, sizeof(b));
+  initsleeplock(&b.lock, "direct");
+  acquiresleep(&b.lock);
+  b.dev = dev;
+  b.blockno = blockno;
+  if(write){
+    memmove(b.data, data, BSIZE);
+    b.flags = B_DIRTY;
+  }
+  iderw(&b);
+  if(!write)
+    memmove(data, b.data, BSIZE);
+  releasesleep(&b.lock);
+}
+
 // Release a locked buffer.
 // Move to the head of the MRU list.
 void
@@ -136,9 +256,48 @@ brelse(struct buf *b)
     bcache.head.next->prev = b;
     bcache.head.next = b;
   }
-  
+
+  release(&bcache.lock);
+}
+
+// Give back to the page allocator the least recently used page
+// of buffers that are all unused and clean.  The buffers of
+// bcache.buf[] always stay.  Returns 1 if a page was freed.
+int
+bshrink(void)
+{
+  struct buf *b, *first;
+  int i;
+
+  acquire(&bcache.lock);
+  for(b = bcache.head.prev; b != &bcache.head; b = b->prev){
+    if(b >= bcache.buf && b < bcache.buf+NBUF)
+      continue;
+    first = (struct buf*)PGROUNDDOWN((uint)b);
+    for(i = 0; i < BUFPERPG; i++)
+      if(first[i].refcnt != 0 || (first[i].flags & B_DIRTY))
+        break;
+    if(i < BUFPERPG)
+      continue;
+    for(i = 0; i < BUFPERPG; i++){
+      bforget(&first[i]);
+      first[i].next->prev = first[i].prev;
+      first[i].prev->next = first[i].next;
+    }
+    bcache.npages--;
+    release(&bcache.lock);
+    kfree((char*)first);
+    return 1;
+  }
   release(&bcache.lock);
+  return 0;
+}
+
+// Pages of memory the buffer cache takes up.
+int
+bcache_pages(void)
+{
+  return (NBUF*sizeof(struct buf) + PGSIZE-1) / PGSIZE + bcache.npages;
 }
 //PAGEBREAK!
 // Blank page.
-
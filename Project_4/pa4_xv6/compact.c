@@ -0,0 +1,39 @@
+// compact: compact physical memory and show the free blocks it made.
+// Prints the number of free blocks of each order, 2^order pages,
+// before and after.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "vmstat.h"
+
+static void
+blocks(char *when, struct vmstat *v)
+{
+  int i;
+
+  printf(1, "%s:", when);
+  for(i = 0; i < NFREEORDER; i++)
+    printf(1, " %d", v->free_blocks[i]);
+  printf(1, "\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct vmstat v;
+  int moved;
+
+  if(argc != 1){
+    printf(2, "Usage: compact\n");
+    exit();
+  }
+  vmstat(&v);
+  printf(1, "free blocks of order 0 to %d\n", NFREEORDER - 1);
+  blocks("before", &v);
+  moved = compact();
+  vmstat(&v);
+  blocks("after ", &v);
+  printf(1, "%d pages moved\n", moved);
+  exit();
+}
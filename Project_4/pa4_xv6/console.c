@@ -232,14 +232,19 @@ consoleintr(int (*getc)(void))
   }
 }
 
+// Characters are gathered under cons.lock and copied out to the
+// user's buffer after releasing it, since that copy may fault on a
+// page that is swapped out, and swapping it in sleeps.
 int
 consoleread(struct inode *ip, char *dst, int n)
 {
   uint target;
-  int c;
+  int c, m;
+  char buf[INPUT_BUF];
 
   iunlock(ip);
   target = n;
+  m = 0;
   acquire(&cons.lock);
   while(n > 0){
     while(input.r == input.w){
@@ -259,13 +264,25 @@ consoleread(struct inode *ip, char *dst, int n)
       }
       break;
     }
-    *dst++ = c;
+    buf[m++] = c;
     --n;
     if(c == '\n')
       break;
+    if(m == sizeof(buf)){
+      release(&cons.lock);
+      if(umove(dst, buf, m) < 0){
+        ilock(ip);
+        return -1;
+      }
+      dst += m;
+      m = 0;
+      acquire(&cons.lock);
+    }
   }
   release(&cons.lock);
   ilock(ip);
+  if(umove(dst, buf, m) < 0)
+    return -1;
 
   return target - n;
 }
@@ -273,13 +290,21 @@ consoleread(struct inode *ip, char *dst, int n)
 int
 consolewrite(struct inode *ip, char *buf, int n)
 {
-  int i;
+  int i, j, m;
+  char kbuf[INPUT_BUF];
 
   iunlock(ip);
-  acquire(&cons.lock);
-  for(i = 0; i < n; i++)
-    consputc(buf[i] & 0xff);
-  release(&cons.lock);
+  for(i = 0; i < n; i += m){
+    m = n - i < sizeof(kbuf) ? n - i : sizeof(kbuf);
+    if(umove(kbuf, buf + i, m) < 0){
+      ilock(ip);
+      return -1;
+    }
+    acquire(&cons.lock);
+    for(j = 0; j < m; j++)
+      consputc(kbuf[j] & 0xff);
+    release(&cons.lock);
+  }
   ilock(ip);
 
   return n;
@@ -9,12 +9,18 @@ struct spinlock;
 struct sleeplock;
 struct stat;
 struct superblock;
+struct swapslot;
+struct vmstat;
+struct zswapstat;
 
 // bio.c
 void            binit(void);
 struct buf*     bread(uint, uint);
 void            brelse(struct buf*);
 void            bwrite(struct buf*);
+void            bdirect(uint, uint, void*, int);
+int             bshrink(void);
+int             bcache_pages(void);
 
 // console.c
 void            consoleinit(void);
@@ -52,13 +58,12 @@ struct inode*   nameiparent(char*, char*);
 int             readi(struct inode*, char*, uint, uint);
 void            stati(struct inode*, struct stat*);
 int             writei(struct inode*, char*, uint, uint);
-void swapread(char* ptr, int blkno);
-void swapwrite(char* ptr, int blkno);
 
 // ide.c
 void            ideinit(void);
-void            ideintr(void);
+void            ideintr(int);
 void            iderw(struct buf*);
+uint            idesize(int);
 
 // ioapic.c
 void            ioapicenable(int irq, int cpu);
@@ -67,15 +72,25 @@ void            ioapicinit(void);
 
 // kalloc.c
 char*           kalloc(void);
+char*           kalloc_cache(void);
+void            note_file_refault(void);
+void            swapin_all(void);
+int             ksm_scan(int);
+void            ksm_dup(pde_t*, uint);
+int             compact(void);
 void            kfree(char*);
 void            kinit1(void*, void*);
 void            kinit2(void*, void*);
+void            pgdir_init(pde_t*);
+void            pgdir_usage(pde_t*, int*, int*, int*);
+void            vm_getstat(struct vmstat*);
 
 // kbd.c
 void            kbdintr(void);
 
 // lapic.c
 void            cmostime(struct rtcdate *r);
+uint            memtop(void);
 int             lapicid(void);
 extern volatile uint*    lapic;
 void            lapiceoi(void);
@@ -110,6 +125,12 @@ void            exit(void);
 int             fork(void);
 int             growproc(int);
 int             kill(int);
+struct proc*    oom_kill(void);
+struct proc*    idle_victim(void);
+void            idle_swapped(struct proc*);
+struct proc*    ksm_hold(int);
+void            ksm_unhold(struct proc*);
+struct proc*    pgdir_hold(pde_t*);
 struct cpu*     mycpu(void);
 struct proc*    myproc();
 void            pinit(void);
@@ -123,6 +144,25 @@ int             wait(void);
 void            wakeup(void*);
 void            yield(void);
 
+// zswap.c
+void            zswapinit(void);
+int             zswap_store(int, char*, char*);
+int             zswap_load(int, char*);
+int             zswap_has(int);
+void            zswap_invalidate(int);
+void            zswap_getstat(struct zswapstat*);
+
+// swap.c
+void            swapinit(void);
+int             swapon(struct inode*, int);
+int             swapoff(int);
+void            swap_usage(int*, int*);
+int             swap_reserve(int);
+void            swap_release(int);
+struct swapslot* slotinfo(int);
+int swapread(char* ptr, int blkno);
+int swapwrite(char* ptr, int blkno);
+
 // swtch.S
 void            swtch(struct context**, struct context*);
 
@@ -153,9 +193,9 @@ char*           strncpy(char*, const char*, int);
 // syscall.c
 int             argint(int, int*);
 int             argptr(int, char**, int);
-int             argstr(int, char**);
+int             argstr(int, char*, int);
 int             fetchint(uint, int*);
-int             fetchstr(uint, char**);
+int             fetchstr(uint, char*, int);
 void            syscall(void);
 
 // timer.c
@@ -172,6 +212,9 @@ void            uartinit(void);
 void            uartintr(void);
 void            uartputc(int);
 
+// umove.S
+int             umove(void*, void*, uint);
+
 // vm.c
 void            seginit(void);
 void            kvmalloc(void);
@@ -192,10 +235,11 @@ void            clearpteu(pde_t *pgdir, char *uva);
 #define NELEM(x) (sizeof(x)/sizeof((x)[0]))
 
 
-void mov_buff(int oldoff, int maximum_swap, int newoff);
 void pagelist_insertion(char* virtual_addr, int success, unsigned int* pgdir);
 int getpid(void);
-void page_fault_handle(unsigned int trap_no, unsigned int fault_addr, unsigned int* page_dir);
+int page_fault_handle(unsigned int trap_no, unsigned int fault_addr, unsigned int* page_dir);
 unsigned int* walkpgdir(unsigned int *pgdir, const void* va, int alloc);
 char page_list_remove(char* virtual_addr, int success, unsigned int* pgdir);
-void swap_send(unsigned int* page_dir, int next_offset, unsigned int * next_pgdir, int idx); 
\ No newline at end of file
+int swap_send(unsigned int* page_dir, int next_offset, unsigned int * next_pgdir, int idx);
+int mlock_range(pde_t* pgdir, uint start, uint end, int lock);
+void mlock_future(pde_t* pgdir, int on);
\ No newline at end of file
@@ -35,3 +35,4 @@ struct devsw {
 extern struct devsw devsw[];
 
 #define CONSOLE 1
+#define DISK    2  // IDE disk; minor is the disk number
@@ -26,8 +26,6 @@ static void itrunc(struct inode*);
 // there should be one superblock per disk device, but we run with
 // only one device
 struct superblock sb; 
-int nr_sectors_read;
-int nr_sectors_write;
 // Read the super block.
 void
 readsb(int dev, struct superblock *sb)
@@ -471,7 +469,10 @@ readi(struct inode *ip, char *dst, uint off, uint n)
   for(tot=0; tot<n; tot+=m, off+=m, dst+=m){
     bp = bread(ip->dev, bmap(ip, off/BSIZE));
     m = min(n - tot, BSIZE - off%BSIZE);
-    memmove(dst, bp->data + off%BSIZE, m);
+    if(umove(dst, bp->data + off%BSIZE, m) < 0){
+      brelse(bp);
+      return -1;
+    }
     brelse(bp);
   }
   return n;
@@ -500,7 +501,11 @@ writei(struct inode *ip, char *src, uint off, uint n)
   for(tot=0; tot<n; tot+=m, off+=m, src+=m){
     bp = bread(ip->dev, bmap(ip, off/BSIZE));
     m = min(n - tot, BSIZE - off%BSIZE);
-    memmove(bp->data + off%BSIZE, src, m);
+    if(umove(bp->data + off%BSIZE, src, m) < 0){
+      log_write(bp);  // part of it may have been copied
+      brelse(bp);
+      return -1;
+    }
     log_write(bp);
     brelse(bp);
   }
@@ -670,83 +675,3 @@ nameiparent(char *path, char *name)
 {
   return namex(path, 1, name);
 }
-
-void swapread(char* ptr, int blkno)
-{
-	struct buf* bp;
-	int i;
-
-	const int BLKS_PER_PG = PGSIZE/BSIZE;
-
-	if ( blkno < 0 || blkno >= SWAPMAX / BLKS_PER_PG )
-		panic("swapread: blkno exceeded range");
-
-	for ( i=0; i < BLKS_PER_PG; ++i ) {
-		nr_sectors_read++;
-		bp = bread(0, SWAPBASE + BLKS_PER_PG * blkno + i);
-		memmove(ptr + i * BSIZE, bp->data, BSIZE);
-		brelse(bp);
-	}
-}
-
-void swapwrite(char* ptr, int blkno)
-{
-	struct buf* bp;
-	int i;
-
-	const int BLKS_PER_PG = PGSIZE/BSIZE;
-
-	if ( blkno < 0 || blkno >= SWAPMAX / BLKS_PER_PG )
-		panic("swapwrite: blkno exceeded range");
-
-	for ( i=0; i < BLKS_PER_PG; ++i ) {
-		nr_sectors_write++;
-		bp = bread(0, SWAPBASE + BLKS_PER_PG * blkno + i);
-		memmove(bp->data, ptr + i * BSIZE, BSIZE);
-		bwrite(bp);
-		brelse(bp);
-	}
-}
-
-int get_swap_idx(int offset, int block_idx){
-  return offset * 8 + SWAPBASE + block_idx;
-}
-
-void mov_buff(int from, int maximum_swap, int to)
-{//from to 둘다 offset
-    int block_idx;//
-    if(to && to<maximum_swap/8){
-      for(
-        block_idx = 0;
-        block_idx < 8;
-        block_idx++
-      ) // Block enumerate
-      {
-        // Lock이 된 버퍼 할당
-        struct buf* from_block = bread(
-          0, get_swap_idx(from, block_idx)
-        );
-        struct buf* to_block = bread(
-          0, get_swap_idx(to, block_idx)
-        );
-
-        from_block->refcnt += 1;
-        to_block->refcnt += 1;
-
-        memmove(to_block->data, from_block->data, 512);
-        bwrite(to_block);
-
-
-        from_block->refcnt -= 1;
-        to_block->refcnt -= 1;
-
-        // 락 해제
-        brelse(from_block);
-        brelse(to_block);
-      }
-    }
-    else{
-      cprintf("Something wrong with condition!!");
-      exit();
-    }
-}
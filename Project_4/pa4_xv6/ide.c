@@ -1,4 +1,6 @@
 // Simple PIO-based (non-DMA) IDE driver code.
+// Drives two channels: disks 0 and 1 on the primary, 2 and 3
+// (QEMU -drive index=2,3) on the secondary.
 
 #include "types.h"
 #include "defs.h"
@@ -17,66 +19,107 @@
 #define IDE_BSY       0x80
 #define IDE_DRDY      0x40
 #define IDE_DF        0x20
+#define IDE_DRQ       0x08
 #define IDE_ERR       0x01
 
 #define IDE_CMD_READ  0x20
 #define IDE_CMD_WRITE 0x30
 #define IDE_CMD_RDMUL 0xc4
 #define IDE_CMD_WRMUL 0xc5
+#define IDE_CMD_IDENT 0xec
 
-// idequeue points to the buf now being read/written to the disk.
-// idequeue->qnext points to the next buf to be processed.
+#define NIDE          4
+
+// idequeue[c] points to the buf now being read/written on channel c.
+// idequeue[c]->qnext points to the next buf to be processed.
 // You must hold idelock while manipulating queue.
 
 static struct spinlock idelock;
-static struct buf *idequeue;
+static struct buf *idequeue[2];
 
-static int havedisk1;
+static ushort iobase[2] = { 0x1f0, 0x170 };
+static ushort ctlbase[2] = { 0x3f6, 0x376 };
+static uint disksize[NIDE];   // in blocks; 0 if the disk is absent
 static void idestart(struct buf*);
 
-// Wait for IDE disk to become ready.
+// Wait for IDE channel ch to become ready.
 static int
-idewait(int checkerr)
+idewait(int ch, int checkerr)
 {
   int r;
 
-  while(((r = inb(0x1f7)) & (IDE_BSY|IDE_DRDY)) != IDE_DRDY)
+  while(((r = inb(iobase[ch]+7)) & (IDE_BSY|IDE_DRDY)) != IDE_DRDY)
     ;
   if(checkerr && (r & (IDE_DF|IDE_ERR)) != 0)
     return -1;
   return 0;
 }
 
+// Ask disk dev for its size.  Returns the size in blocks,
+// or 0 if the disk is not present.
+static uint
+ideidentify(int dev)
+{
+  ushort id[SECTOR_SIZE/2];
+  int ch, i, r;
+
+  ch = dev >> 1;
+  outb(ctlbase[ch], 2);  // no interrupt for this command
+  outb(iobase[ch]+6, 0xe0 | ((dev&1)<<4));
+  for(i=0; i<1000; i++){
+    if((r = inb(iobase[ch]+7)) != 0)
+      break;
+  }
+  if(r == 0 || r == 0xff)
+    return 0;
+  outb(iobase[ch]+7, IDE_CMD_IDENT);
+  for(i=0; i<100000; i++){
+    if(((r = inb(iobase[ch]+7)) & IDE_BSY) == 0)
+      break;
+  }
+  if((r & (IDE_BSY|IDE_ERR|IDE_DRQ)) != IDE_DRQ)
+    return 0;
+  insl(iobase[ch], id, SECTOR_SIZE/4);
+  // Words 60-61: number of sectors addressable with LBA28.
+  return (id[60] | (id[61] << 16)) / (BSIZE/SECTOR_SIZE);
+}
+
 void
 ideinit(void)
 {
-  int i;
+  int dev;
 
   initlock(&idelock, "ide");
   ioapicenable(IRQ_IDE, ncpu - 1);
-  idewait(0);
+  idewait(0, 0);
 
-  // Check if disk 1 is present
-  outb(0x1f6, 0xe0 | (1<<4));
-  for(i=0; i<1000; i++){
-    if(inb(0x1f7) != 0){
-      havedisk1 = 1;
-      break;
-    }
-  }
+  for(dev = 0; dev < NIDE; dev++)
+    disksize[dev] = ideidentify(dev);
+  if(disksize[2] || disksize[3])
+    ioapicenable(IRQ_IDE+1, ncpu - 1);
 
   // Switch back to disk 0.
   outb(0x1f6, 0xe0 | (0<<4));
 }
 
+// Size of disk dev in blocks, 0 if there is no such disk.
+uint
+idesize(int dev)
+{
+  if(dev < 0 || dev >= NIDE)
+    return 0;
+  return disksize[dev];
+}
+
 // Start the request for b.  Caller must hold idelock.
 static void
 idestart(struct buf *b)
 {
   if(b == 0)
     panic("idestart");
-  if(b->blockno >= FSSIZE)
+  if(b->blockno >= disksize[b->dev])
     panic("incorrect blockno");
+  int ch = b->dev >> 1;
   int sector_per_block =  BSIZE/SECTOR_SIZE;
   int sector = b->blockno * sector_per_block;
   int read_cmd = (sector_per_block == 1) ? IDE_CMD_READ :  IDE_CMD_RDMUL;
@@ -84,39 +127,39 @@ idestart(struct buf *b)
 
   if (sector_per_block > 7) panic("idestart");
 
-  idewait(0);
-  outb(0x3f6, 0);  // generate interrupt
-  outb(0x1f2, sector_per_block);  // number of sectors
-  outb(0x1f3, sector & 0xff);
-  outb(0x1f4, (sector >> 8) & 0xff);
-  outb(0x1f5, (sector >> 16) & 0xff);
-  outb(0x1f6, 0xe0 | ((b->dev&1)<<4) | ((sector>>24)&0x0f));
+  idewait(ch, 0);
+  outb(ctlbase[ch], 0);  // generate interrupt
+  outb(iobase[ch]+2, sector_per_block);  // number of sectors
+  outb(iobase[ch]+3, sector & 0xff);
+  outb(iobase[ch]+4, (sector >> 8) & 0xff);
+  outb(iobase[ch]+5, (sector >> 16) & 0xff);
+  outb(iobase[ch]+6, 0xe0 | ((b->dev&1)<<4) | ((sector>>24)&0x0f));
   if(b->flags & B_DIRTY){
-    outb(0x1f7, write_cmd);
-    outsl(0x1f0, b->data, BSIZE/4);
+    outb(iobase[ch]+7, write_cmd);
+    outsl(iobase[ch], b->data, BSIZE/4);
   } else {
-    outb(0x1f7, read_cmd);
+    outb(iobase[ch]+7, read_cmd);
   }
 }
 
-// Interrupt handler.
+// Interrupt handler for channel ch.
 void
-ideintr(void)
+ideintr(int ch)
 {
   struct buf *b;
 
   // First queued buffer is the active request.
   acquire(&idelock);
 
-  if((b = idequeue) == 0){
+  if((b = idequeue[ch]) == 0){
     release(&idelock);
     return;
   }
-  idequeue = b->qnext;
+  idequeue[ch] = b->qnext;
 
   // Read data if needed.
-  if(!(b->flags & B_DIRTY) && idewait(1) >= 0)
-    insl(0x1f0, b->data, BSIZE/4);
+  if(!(b->flags & B_DIRTY) && idewait(ch, 1) >= 0)
+    insl(iobase[ch], b->data, BSIZE/4);
 
   // Wake process waiting for this buf.
   b->flags |= B_VALID;
@@ -124,8 +167,8 @@ ideintr(void)
   wakeup(b);
 
   // Start disk on next buf in queue.
-  if(idequeue != 0)
-    idestart(idequeue);
+  if(idequeue[ch] != 0)
+    idestart(idequeue[ch]);
 
   release(&idelock);
 }
@@ -143,19 +186,19 @@ iderw(struct buf *b)
     panic("iderw: buf not locked");
   if((b->flags & (B_VALID|B_DIRTY)) == B_VALID)
     panic("iderw: nothing to do");
-  if(b->dev != 0 && !havedisk1)
-    panic("iderw: ide disk 1 not present");
+  if(b->dev >= NIDE || disksize[b->dev] == 0)
+    panic("iderw: ide disk not present");
 
   acquire(&idelock);  //DOC:acquire-lock
 
   // Append b to idequeue.
   b->qnext = 0;
-  for(pp=&idequeue; *pp; pp=&(*pp)->qnext)  //DOC:insert-queue
+  for(pp=&idequeue[b->dev>>1]; *pp; pp=&(*pp)->qnext)  //DOC:insert-queue
     ;
   *pp = b;
 
   // Start disk if necessary.
-  if(idequeue == b)
+  if(idequeue[b->dev>>1] == b)
     idestart(b);
 
   // Wait for request to finish.
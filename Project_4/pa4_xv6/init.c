@@ -10,7 +10,7 @@ char *argv[] = { "sh", 0 };
 int
 main(void)
 {
-  int pid, wpid;
+  int pid, wpid, fd;
 
   if(open("console", O_RDWR) < 0){
     mknod("console", 1, 1);
@@ -18,6 +18,10 @@ main(void)
   }
   dup(0);  // stdout
   dup(0);  // stderr
+  if((fd = open("hdc", O_RDONLY)) < 0)
+    mknod("hdc", 2, 2);  // third IDE disk, for swapon
+  else
+    close(fd);
 
   for(;;){
     printf(1, "init: starting sh\n");
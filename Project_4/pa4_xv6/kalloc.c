@@ -7,20 +7,50 @@
 #include "param.h"
 #include "memlayout.h"
 #include "mmu.h"
+#include "x86.h"
+#include "proc.h"
 #include "spinlock.h"
+#include "sleeplock.h"
+#include "traps.h"
+#include "vmstat.h"
+#include "swap.h"
 
 void freerange(void *vstart, void *vend);
 extern char end[]; // first address after kernel loaded from ELF file
                    // defined by the kernel linker script in kernel.ld
 char parity_check(void);
-void swap_out(struct page*);
+int swap_out(struct page*);
 
-struct spinlock paging_lock;
-struct spinlock clock_algorithm_lock;
-int pages_valid_bits[PHYSTOP/4096];
+#define SWAP_RA_MAX  16   // most pages read ahead on one swap-in
+#define SWAP_RA_MIN_FREE (2 * SWAP_RA_MAX)  // keep these free when reading ahead
+#define SWAPIN_BATCH 32   // pages swapin_all() reads in one pass
+
+struct sleeplock paging_lock;          // serializes swap I/O
+struct spinlock clock_algorithm_lock;  // LRU list, swap map, swap cache
+
+// The refs of each swap slot (see swap.h) count one per swapped-out
+// PTE that names the slot plus one per frame that still holds its
+// contents (struct page swap_slot).  Slots are shared across fork()
+// and only rewritten while a single reference remains.
+extern int nswapslots;
+int num_swap_slots;  // slots with references
+
+// Event counters reported by vmstat(); the gauges are filled in
+// by vm_getstat().  Protected by clock_algorithm_lock.
+static struct vmstat vmcount;
+
+// Recent refaults of file blocks and of anonymous pages, halved
+// together every REFAULT_WINDOW so that they follow the current
+// load.  parity_check() reclaims from the side refaulting less.
+// Protected by clock_algorithm_lock.
+#define REFAULT_WINDOW 1024
+static int file_refaults, anon_refaults;
+
+#define CACHE_MIN_FREE 256  // caches only grow while this many pages are free
 
 struct run {
   struct run *next;
+  struct run *prev;
 };
 
 struct {
@@ -29,10 +59,55 @@ struct {
   struct run *freelist;
 } kmem;
 
-struct page pages[PHYSTOP/PGSIZE];
-struct page *page_lru_head;
+#define NPAGES (PHYSTOP/PGSIZE)
+struct page pages[NPAGES];  // indexed by physical page number
+// User pages are on one of two LRU lists.  New pages start on the
+// inactive list and only move to the active list when the clock
+// finds them accessed twice in a row; the active list is aged back
+// into the inactive list so that it stays no bigger.  Only inactive
+// pages are evicted, so pages touched once cannot push out the
+// working set.
+// mlock()ed pages are kept apart on the unevictable list.
+struct page *page_active_head;
+struct page *page_inactive_head;
+struct page *page_unevictable_head;
 int num_free_pages;
-int num_lru_pages;
+int num_lru_pages;     // on the active or inactive list
+int num_active_pages;
+int num_locked_pages;
+
+// Swap cache: frames that hold a copy of a swap slot but are not
+// mapped yet, filled by swap-in readahead.  The cache field of a
+// slot finds its frame; swap_cache_head is a FIFO used to drop them.
+struct page *swap_cache_head;
+int num_swap_cache_pages;
+
+// Readahead window, grown while prefetched pages get used and
+// shrunk while they do not.
+int swap_ra_window = 1;
+int swap_ra_hits;
+int swap_ra_pages;
+
+// Evictions of clean pages that still had their swap slot.
+int swap_clean_drops;
+
+// Kernel same-page merging.  ksm_scan() looks through the pages of
+// one process at a time and merges pages of equal contents into a
+// single read-only frame, marked PG_KSM and kept off the LRU lists;
+// PTE_KSM in a PTE that maps it tells a write fault to give the
+// writer a copy.  Merged frames are found by checksum in ksm_hash[],
+// chained through next.  A page is only merged once its checksum
+// has stayed the same for a whole pass, and only with a merged
+// frame or with a page remembered from this pass in ksm_seen[].
+// Protected by clock_algorithm_lock.
+#define NKSMHASH 251
+struct page *ksm_hash[NKSMHASH];
+struct page *ksm_seen[NKSMHASH];  // unmerged pages seen this pass
+int num_ksm_pages;    // merged frames
+int num_ksm_sharing;  // PTEs that map them
+int ksm_pid;          // where ksm_scan() goes on from
+uint ksm_va;
+struct sleeplock ksm_lock;  // one ksm_scan() at a time
 
 // Initialization happens in two phases.
 // 1. main() calls kinit1() while still using entrypgdir to place just
@@ -43,6 +118,9 @@ void
 kinit1(void *vstart, void *vend)
 {
   initlock(&kmem.lock, "kmem");
+  initlock(&clock_algorithm_lock, "clock_algorithm");
+  initsleeplock(&paging_lock, "paging");
+  initsleeplock(&ksm_lock, "ksm");
   kmem.use_lock = 0;
   freerange(vstart, vend);
 }
@@ -71,6 +149,7 @@ void
 kfree(char *v)
 {
   struct run *r;
+  struct page *pge;
 
   if((uint)v % PGSIZE || v < end || V2P(v) >= PHYSTOP)
     panic("kfree");
@@ -83,151 +162,748 @@ kfree(char *v)
 
   if(kmem.use_lock)
     acquire(&kmem.lock);
+  // Forget the last owner.  Whoever allocates the frame next may use
+  // the union for something else: csum would read as a page
+  // directory's counters.
+  pge = &pages[V2P(v) / PGSIZE];
+  pge->flags = PG_FREE;
+  pge->pgdir = 0;
+  pge->vaddr = 0;
+  pge->swap_slot = 0;
+  pge->csum = 0;
   r = (struct run*)v;
   r->next = kmem.freelist;
+  r->prev = 0;
+  if(kmem.freelist)
+    kmem.freelist->prev = r;
   kmem.freelist = r;
   if(kmem.use_lock)
     release(&kmem.lock);
 }
 
+// Take a page off the free list without reclaiming.
+// Returns 0 if the free list is empty.
+static char*
+kalloc_nowait(void)
+{
+  struct run *r;
+
+  if(kmem.use_lock)
+    acquire(&kmem.lock);
+  r = kmem.freelist;
+  if(r){
+    num_free_pages--;
+    kmem.freelist = r->next;
+    if(kmem.freelist)
+      kmem.freelist->prev = 0;
+    pages[V2P(r) / PGSIZE].flags = 0;
+  }
+  if(kmem.use_lock)
+    release(&kmem.lock);
+  return (char*)r;
+}
+
+// Take the free page at pfn off the free list.
+// Caller must hold kmem.lock.
+static char*
+take_page(uint pfn)
+{
+  struct run *r = (struct run*)P2V(pfn * PGSIZE);
+
+  if(r->prev)
+    r->prev->next = r->next;
+  else
+    kmem.freelist = r->next;
+  if(r->next)
+    r->next->prev = r->prev;
+  pages[pfn].flags = 0;
+  num_free_pages--;
+  return (char*)r;
+}
+
 // Allocate one 4096-byte page of physical memory.
 // Returns a pointer that the kernel can use.
 // Returns 0 if the memory cannot be allocated.
 char*
 kalloc(void)
 {
-  struct run *r;
-  while(1){
-    if(kmem.use_lock)
-        acquire(&kmem.lock);
-    if(!(r = kmem.freelist))
-    {
-        if(!kmem.use_lock){
-            if(!parity_check()) 
-            {
-                panic("OOM\n"); return 0;
-            }
-        }
-        else{
-            release(&kmem.lock);
-        }
+  char *r;
+  struct proc *victim;
+  int locked, stalled = 0;
+
+  while((r = kalloc_nowait()) == 0){
+    // Reclaim sleeps on swap I/O, so it needs a process to sleep in.
+    if(!kmem.use_lock || myproc() == 0)
+      panic("OOM\n");
+    // Nor can a caller holding a spinlock sleep.
+    pushcli();
+    locked = mycpu()->ncli > 1;
+    popcli();
+    if(locked)
+      return 0;
+    if(!stalled){
+      stalled = 1;
+      acquire(&clock_algorithm_lock);
+      vmcount.stalls++;
+      release(&clock_algorithm_lock);
     }
-    else break;
+    if(parity_check())
+      continue;
+
+    // Nothing left to reclaim: kill a process and wait for it to
+    // exit, unless it is this one.
+    victim = oom_kill();
+    if(victim == 0 || victim == myproc() || myproc()->killed)
+      return 0;
+    yield();
   }
-  num_free_pages--;
-  kmem.freelist = r->next;
-  if(kmem.use_lock)
-    release(&kmem.lock);
-  return (char*)r;
+  return r;
+}
+
+// Count free memory as aligned blocks of 2^order pages, taking the
+// largest blocks each run of free pages holds.
+static void
+count_free_blocks(int *nblocks)
+{
+  uint pfn, end, k;
+
+  memset(nblocks, 0, NFREEORDER * sizeof(int));
+  acquire(&kmem.lock);
+  for(pfn = 0; pfn < NPAGES; pfn = end){
+    for(end = pfn; end < NPAGES && (pages[end].flags & PG_FREE); end++)
+      ;
+    if(end == pfn){
+      end++;
+      continue;
+    }
+    while(pfn < end){
+      for(k = NFREEORDER - 1; (pfn & ((1 << k) - 1)) || pfn + (1 << k) > end; k--)
+        ;
+      nblocks[k]++;
+      pfn += 1 << k;
+    }
+  }
+  release(&kmem.lock);
+}
+
+// Allocate a page for a cache that reclaim can shrink again, but
+// only while memory is plentiful.  Never reclaims; returns 0
+// instead.
+char*
+kalloc_cache(void)
+{
+  if(num_free_pages < CACHE_MIN_FREE)
+    return 0;
+  return kalloc_nowait();
+}
+
+
+// Link pge in at the tail of the circular list at *head, which for
+// the LRU list is just behind the clock hand.
+// Caller must hold clock_algorithm_lock.
+static void
+page_link(struct page **head, struct page *pge)
+{
+    if(*head){
+        pge->next = *head;
+        pge->prev = (*head)->prev;
+        (*head)->prev->next = pge;
+        (*head)->prev = pge;
+    }
+    else{
+        *head = pge;
+        pge->next = pge;
+        pge->prev = pge;
+    }
+}
+
+static void
+page_unlink(struct page **head, struct page *pge)
+{
+    if(pge->next == pge)
+        *head = 0;
+    else{
+        if(*head == pge)
+            *head = pge->next;
+        pge->next->prev = pge->prev;
+        pge->prev->next = pge->next;
+    }
+    pge->next = 0;
+    pge->prev = 0;
+}
+
+static struct page*
+pa2page(uint pa)
+{
+    return &pages[pa / PGSIZE];
+}
+
+static char*
+page2kva(struct page *pge)
+{
+    return P2V((pge - pages) * PGSIZE);
+}
+
+// Count a refault of a file block (file != 0) or an anonymous page.
+// Caller must hold clock_algorithm_lock.
+static void
+refault(int file)
+{
+    if(file){
+        file_refaults++;
+        vmcount.file_refaults++;
+    }
+    else
+        anon_refaults++;
+    if(file_refaults + anon_refaults > REFAULT_WINDOW){
+        file_refaults /= 2;
+        anon_refaults /= 2;
+    }
+}
+
+// The buffer cache read a block it had dropped a short while ago.
+void
+note_file_refault(void)
+{
+    acquire(&clock_algorithm_lock);
+    refault(1);
+    release(&clock_algorithm_lock);
+}
+
+// Fill in *st with the paging counters and current page counts.
+void
+vm_getstat(struct vmstat *st)
+{
+    acquire(&clock_algorithm_lock);
+    *st = vmcount;
+    st->free_pages = num_free_pages;
+    st->active_pages = num_active_pages;
+    st->inactive_pages = num_lru_pages - num_active_pages;
+    st->locked_pages = num_locked_pages;
+    st->swapcache_pages = num_swap_cache_pages;
+    st->swap_slots = num_swap_slots;
+    st->ksm_pages = num_ksm_pages;
+    st->ksm_sharing = num_ksm_sharing;
+    release(&clock_algorithm_lock);
+    st->file_pages = bcache_pages();
+    count_free_blocks(st->free_blocks);
+    swap_usage(&st->swap_total, &st->swap_free);
+}
+
+// Start counting the user pages of pgdir, a page directory just
+// allocated.
+void
+pgdir_init(pde_t *pgdir)
+{
+    struct page *pge = pa2page(V2P(pgdir));
+
+    pge->rss = 0;
+    pge->nswap = 0;
+    pge->nlocked = 0;
+}
+
+// Report the resident, swapped-out and locked user pages of pgdir,
+// which are counted in the struct page of the page directory.
+void
+pgdir_usage(pde_t *pgdir, int *rss, int *nswap, int *nlocked)
+{
+    struct page *pge = pa2page(V2P(pgdir));
+
+    *rss = pge->rss;
+    *nswap = pge->nswap;
+    *nlocked = pge->nlocked;
+}
+
+// Add pge at the tail of the LRU list its flags name.
+// Caller must hold clock_algorithm_lock.
+static void
+lru_add(struct page *pge)
+{
+    if(pge->flags & PG_LOCKED){
+        page_link(&page_unevictable_head, pge);
+        pa2page(V2P(pge->pgdir))->nlocked++;
+        num_locked_pages++;
+        return;
+    }
+    if(pge->flags & PG_ACTIVE){
+        page_link(&page_active_head, pge);
+        num_active_pages++;
+    }
+    else
+        page_link(&page_inactive_head, pge);
+    num_lru_pages++;
+}
+
+static void
+lru_del(struct page *pge)
+{
+    if(pge->flags & PG_LOCKED){
+        page_unlink(&page_unevictable_head, pge);
+        pa2page(V2P(pge->pgdir))->nlocked--;
+        num_locked_pages--;
+        return;
+    }
+    if(pge->flags & PG_ACTIVE){
+        page_unlink(&page_active_head, pge);
+        num_active_pages--;
+    }
+    else
+        page_unlink(&page_inactive_head, pge);
+    num_lru_pages--;
+}
+
+// Age the oldest active page: if it was accessed since the last
+// look it goes round again, otherwise it moves to the inactive list.
+// Caller must hold clock_algorithm_lock.
+static void
+lru_age(void)
+{
+    struct page *pge = page_active_head;
+    pte_t *pte = walkpgdir(pge->pgdir, (void*)pge->vaddr, 0);
+
+    if(*pte & PTE_A){
+        *pte &= ~PTE_A;
+        page_active_head = pge->next;
+        return;
+    }
+    lru_del(pge);
+    pge->flags = 0;
+    lru_add(pge);
+}
+
+// Drop stale TLB entries after editing a PTE of pgdir.
+// Only the running CPU is flushed; xv6 has no TLB shootdown.
+static void
+flush_tlb(pde_t *pgdir)
+{
+    struct proc *curproc = myproc();
+
+    if(curproc && curproc->pgdir == pgdir)
+        lcr3(V2P(pgdir));
+}
+
+// Allocate a free swap slot, searching on from the last one handed
+// out so that pages evicted together land next to each other.
+// Slot 0 is never used.  Returns 0 when swap is full.
+// Caller must hold clock_algorithm_lock.
+static int
+swap_alloc_slot(void)
+{
+    static int hint = 1;
+    struct swapslot *ss;
+    int n, slot;
+
+    for(n = 1; n < nswapslots; n++){
+        slot = hint++;
+        if(hint >= nswapslots)
+            hint = 1;
+        ss = slotinfo(slot);
+        if(!ss->refs){
+            ss->refs = 1;
+            num_swap_slots++;
+            return slot;
+        }
+    }
+    return 0;
+}
+
+static struct page*
+swap_cache_take(int slot)
+{
+    struct page *pge = slotinfo(slot)->cache;
+
+    if(pge){
+        slotinfo(slot)->cache = 0;
+        page_unlink(&swap_cache_head, pge);
+        pge->swap_slot = 0;
+        num_swap_cache_pages--;
+    }
+    return pge;
+}
+
+// Drop one reference to a swap slot.  The last one frees the slot
+// along with any cached copy of it.
+// Caller must hold clock_algorithm_lock.
+static void
+swap_free_slot(int slot)
+{
+    struct swapslot *ss = slotinfo(slot);
+    struct page *pge;
+
+    if(ss->refs <= 0)
+        panic("swap_free_slot");
+    if(--ss->refs > 0)
+        return;
+    num_swap_slots--;
+    zswap_invalidate(slot);
+    swap_release(slot);
+    if((pge = swap_cache_take(slot)))
+        kfree(page2kva(pge));
+}
+
+// Put pge, mapped at va in pgdir, on the LRU.
+// Caller must hold clock_algorithm_lock.
+static void
+lru_insert(struct page *pge, pde_t *pgdir, char *va)
+{
+    struct page *dir = pa2page(V2P(pgdir));
+
+    pge->pgdir = pgdir;
+    pge->vaddr = va;
+    pge->flags = 0;
+    if((dir->flags & PG_LOCKALL) && dir->nlocked < MAXLOCKED)
+        pge->flags = PG_LOCKED;
+    lru_add(pge);
 }
 
 void pagelist_insertion(
     char* virtual_addr, int success, unsigned int *page_dir
 )
 {
+    pte_t* page_table_entry = walkpgdir(page_dir, virtual_addr, 0);
+    struct page *pge;
+
+    if(!page_table_entry || !(*page_table_entry & PTE_P))
+        panic("pagelist_insertion");
+    pge = pa2page(PTE_ADDR(*page_table_entry));
+
     acquire(&clock_algorithm_lock);
+    lru_insert(pge, page_dir, virtual_addr);
+    pa2page(V2P(page_dir))->rss++;
+    release(&clock_algorithm_lock);
+}
 
-    struct page* pge = 0;
+// Drop one mapping of the merged frame k.  Returns 1 if it was the
+// last, in which case the caller must free the frame.
+// Caller must hold clock_algorithm_lock.
+static int
+ksm_put(struct page *k)
+{
+    struct page **pp;
 
-    int idx = 0;
+    num_ksm_sharing--;
+    if(--k->mapcount > 0)
+        return 0;
+    for(pp = &ksm_hash[k->csum % NKSMHASH]; *pp != k; pp = &(*pp)->next)
+        ;
+    *pp = k->next;
+    k->next = 0;
+    num_ksm_pages--;
+    return 1;
+}
 
-    for(
-        idx=0;
-        idx<0xE000000/0x1000;
-        idx++
-    )
-        if(!pages[idx].pgdir){
-            success = 1;
-            break;
-        }
-    
-    if (success) pge = &pages[idx];
+// Unmap the user page at virtual_addr: a resident page leaves the
+// LRU list and is freed, a swapped-out page gives up its swap slot.
+// Returns 'e' if there was a page, 'n' otherwise.
+char page_list_remove(
+    char* virtual_addr, int success, unsigned int *page_dir
+)
+{
+    pte_t* page_table_entry;
+    struct page* pge;
+    char *v = 0;
 
-    if(pge){
-        pge->pgdir=page_dir;
-        pge->vaddr=virtual_addr;
-        
-        if(num_lru_pages < 0) cprintf("Wrong num lru condition!");
-        else if(num_lru_pages/2){
-            pge->next = page_lru_head;
-            pge->prev = page_lru_head->prev;
-
-            page_lru_head->prev->next=pge;
-            page_lru_head->prev = pge;
+    acquire(&clock_algorithm_lock);
+    page_table_entry = walkpgdir(page_dir, virtual_addr, 0);
+    if(page_table_entry && (*page_table_entry & PTE_P)){
+        if(PTE_ADDR(*page_table_entry) == 0)
+            panic("kfree");
+        pge = pa2page(PTE_ADDR(*page_table_entry));
+        if(pge->pgdir == page_dir && pge->vaddr == virtual_addr){
+            lru_del(pge);
+            pge->pgdir = 0;
+            pge->vaddr = 0;
+            pa2page(V2P(page_dir))->rss--;
+        }
+        if(pge->swap_slot){
+            swap_free_slot(pge->swap_slot);
+            pge->swap_slot = 0;
+        }
+        v = P2V(PTE_ADDR(*page_table_entry));
+        if(*page_table_entry & PTE_KSM){
+            pa2page(V2P(page_dir))->rss--;
+            if(!ksm_put(pge))
+                v = 0;
         }
-        else if(num_lru_pages%2){
-            pge->next=page_lru_head;
-            pge->prev=page_lru_head;
+        *page_table_entry = 0;
+        success = 1;
+    }
+    else if(page_table_entry && (*page_table_entry & PTE_SWAP)){
+        swap_free_slot(PTE_ADDR(*page_table_entry) / PGSIZE);
+        *page_table_entry = 0;
+        pa2page(V2P(page_dir))->nswap--;
+        success = 1;
+    }
+    release(&clock_algorithm_lock);
+
+    if(v)
+        kfree(v);
+    if(!success) return 'n';
+    else return 'e';
+}
+
+// Put mem, just read from swap slot, in the swap cache.  Returns 0
+// if the slot was freed or cached meanwhile; the caller frees mem.
+// Caller must hold clock_algorithm_lock.
+static int
+swap_cache_add(int slot, char *mem)
+{
+    struct page *pge;
 
-            page_lru_head->prev=pge;
-            page_lru_head->next=pge;
+    if(!slotinfo(slot)->refs || slotinfo(slot)->cache)
+        return 0;
+    pge = pa2page(V2P(mem));
+    pge->swap_slot = slot;
+    slotinfo(slot)->cache = pge;
+    page_link(&swap_cache_head, pge);
+    num_swap_cache_pages++;
+    return 1;
+}
+
+// Prefetch the swapped-out pages that follow faddress in page_dir
+// into the swap cache.  Only takes pages that are already free,
+// since reclaim would need paging_lock, which the caller holds.
+static void
+swap_readahead(unsigned int faddress, unsigned int *page_dir)
+{
+    pte_t* pte;
+    char* mem;
+    uint va;
+    int slot, n;
+
+    for(n = 1; n <= swap_ra_window; n++){
+        va = faddress + n * PGSIZE;
+        if(va >= KERNBASE)
+            break;
+        if((pte = walkpgdir(page_dir, (void*)va, 0)) == 0 || *pte == 0)
+            break;
+        if(!(*pte & PTE_SWAP))
+            continue;
+        slot = PTE_ADDR(*pte) / PGSIZE;
+        if(slotinfo(slot)->cache || zswap_has(slot))
+            continue;
+        if(num_free_pages < SWAP_RA_MIN_FREE || (mem = kalloc_nowait()) == 0)
+            break;
+
+        if(swapread(mem, slot) < 0){  // freed meanwhile: not on disk
+            kfree(mem);
+            continue;
         }
-        else{
-            page_lru_head=pge;
 
-            page_lru_head->next=pge;
-            page_lru_head->prev=pge;
+        acquire(&clock_algorithm_lock);
+        vmcount.swapins++;
+        if(swap_cache_add(slot, mem)){
+            swap_ra_pages++;
+            mem = 0;
         }
         release(&clock_algorithm_lock);
-    }
-    else{
-        cprintf("Page array does not have free space");
+        if(mem)
+            kfree(mem);
     }
 }
 
-char page_list_remove(
-    char* virtual_addr, int success, unsigned int *page_dir
-)
+// Checksum of a page for KSM: 32-bit FNV-1a over its words.
+static uint
+ksm_checksum(char *mem)
+{
+    uint *w = (uint*)mem, h = 2166136261U;
+    int i;
+
+    for(i = 0; i < PGSIZE / sizeof(uint); i++)
+        h = (h ^ w[i]) * 16777619;
+    return h;
+}
+
+// Take pge, mapped by pte, off the LRU for merging.
+// Caller must hold clock_algorithm_lock.
+static void
+ksm_take(struct page *pge, pte_t *pte)
+{
+    lru_del(pge);
+    if(pge->swap_slot)
+        swap_free_slot(pge->swap_slot);
+    pge->pgdir = 0;
+    pge->vaddr = 0;
+    pge->swap_slot = 0;
+    *pte = (*pte & ~PTE_W) | PTE_KSM;
+}
+
+// Merge the page at va in pgdir, which must be held by ksm_hold(),
+// into a frame with the same contents.  Returns 1 if that freed it.
+static int
+ksm_page(pde_t *pgdir, uint va)
 {
-    char default_return_value = 'n';
+    struct page *pge, *k;
+    pte_t *pte;
+    char *mem = 0;
+    uint csum, h;
 
     acquire(&clock_algorithm_lock);
-    unsigned int* page_table_entry= walkpgdir(
-        page_dir, virtual_addr, 0
-    );
+    pte = walkpgdir(pgdir, (void*)va, 0);
+    if(!pte || (*pte & (PTE_P | PTE_W | PTE_U)) != (PTE_P | PTE_W | PTE_U))
+        goto out;
+    pge = pa2page(PTE_ADDR(*pte));
+    if(pge->pgdir != pgdir || pge->vaddr != (char*)va ||
+       (pge->flags & PG_LOCKED))
+        goto out;
+    csum = ksm_checksum(page2kva(pge));
+    if(csum != pge->csum){
+        pge->csum = csum;  // still changing; look again next pass
+        goto out;
+    }
+    h = csum % NKSMHASH;
+    for(k = ksm_hash[h]; k; k = k->next)
+        if(k->csum == csum && memcmp(page2kva(k), page2kva(pge), PGSIZE) == 0)
+            break;
+    if(k == 0){
+        // If a page seen this pass is the same, this one becomes a
+        // merged frame, and that one joins it when its turn comes.
+        k = ksm_seen[h];
+        if(k == 0 || k == pge || k->csum != csum ||
+           memcmp(page2kva(k), page2kva(pge), PGSIZE) != 0){
+            ksm_seen[h] = pge;
+            goto out;
+        }
+        ksm_seen[h] = 0;
+        ksm_take(pge, pte);
+        pge->flags = PG_KSM;
+        pge->mapcount = 1;
+        pge->next = ksm_hash[h];
+        ksm_hash[h] = pge;
+        num_ksm_pages++;
+        num_ksm_sharing++;
+        goto out;
+    }
+    ksm_take(pge, pte);
+    *pte = V2P(page2kva(k)) | PTE_FLAGS(*pte);
+    k->mapcount++;
+    num_ksm_sharing++;
+    vmcount.ksm_merges++;
+    mem = page2kva(pge);
+out:
+    release(&clock_algorithm_lock);
+    if(mem)
+        kfree(mem);
+    return mem != 0;
+}
 
-    if(num_lru_pages){
-        if((*page_table_entry&0x100) >= 0x100) {
-            struct page* pge = page_lru_head;
-            while(1)
-            {
-                if(
-                    pge->vaddr == virtual_addr &&
-                    pge->pgdir == page_dir
-                ){
-                    if(pge!=page_lru_head){
-                        pge->next->prev=pge->prev;
-                        pge->prev->next=pge->next;
-                        
-                        num_lru_pages -= 1;
-                        break;
-                    }
-                    else{
-                        page_lru_head=pge->next;
-                    }
-                }
-                struct page* before = pge;
-                pge=pge->next;
-                if(before == pge){
-                    break;
-                }
-            }
+// Look through up to npages more user pages for ones to merge,
+// one process at a time in pid order, going on from where the
+// last call stopped.  Returns the number of pages merged.
+int
+ksm_scan(int npages)
+{
+    struct proc *p;
+    int merged = 0;
+
+    acquiresleep(&ksm_lock);
+    while(npages > 0){
+        if((p = ksm_hold(ksm_pid)) == 0){
+            // End of a pass.
+            acquire(&clock_algorithm_lock);
+            memset(ksm_seen, 0, sizeof(ksm_seen));
+            release(&clock_algorithm_lock);
+            ksm_pid = 0;
+            break;
         }
-        else
-        {
-            pages_valid_bits[
-                *page_table_entry/4096
-            ]=num_lru_pages;
-            success = 1;
+        if(p->pid != ksm_pid){
+            ksm_pid = p->pid;
+            ksm_va = 0;
         }
+        for(; ksm_va < p->sz && npages > 0; ksm_va += PGSIZE, npages--)
+            merged += ksm_page(p->pgdir, ksm_va);
+        if(ksm_va >= p->sz)
+            ksm_pid++;
+        ksm_unhold(p);
     }
+    releasesleep(&ksm_lock);
+    return merged;
+}
 
+// Count one more mapping, in the new page directory d, of the
+// merged frame at pa, for fork().
+void
+ksm_dup(pde_t *d, uint pa)
+{
+    acquire(&clock_algorithm_lock);
+    pa2page(pa)->mapcount++;
+    num_ksm_sharing++;
+    pa2page(V2P(d))->rss++;
     release(&clock_algorithm_lock);
-    if(!success) return default_return_value;
-    else return 'e';
 }
 
-void page_fault_handle(
+// Give the writer of the merged frame at va a page of its own.  The
+// last sharer takes the frame itself back.  Returns -1 if there is
+// no memory for the copy.
+static int
+ksm_unshare(unsigned int va, pde_t *pgdir)
+{
+    pte_t *pte = walkpgdir(pgdir, (void*)va, 0);
+    struct page *k;
+    char *mem = 0;
+    uint flags;
+
+    // KSM and reclaim leave this PTE alone, but other sharers may
+    // come and go while kalloc() waits.
+    for(;;){
+        acquire(&clock_algorithm_lock);
+        k = pa2page(PTE_ADDR(*pte));
+        if(k->mapcount == 1 || mem)
+            break;
+        release(&clock_algorithm_lock);
+        if((mem = kalloc()) == 0)
+            return -1;
+    }
+    flags = (PTE_FLAGS(*pte) & ~PTE_KSM) | PTE_W;
+    if(mem){
+        memmove(mem, page2kva(k), PGSIZE);
+        *pte = V2P(mem) | flags;
+        lru_insert(pa2page(V2P(mem)), pgdir, (char*)va);
+        if(!ksm_put(k))
+            k = 0;
+    }
+    else{
+        ksm_put(k);
+        *pte = PTE_ADDR(*pte) | flags;
+        lru_insert(k, pgdir, (char*)va);
+        k = 0;
+    }
+    vmcount.ksm_unmerges++;
+    release(&clock_algorithm_lock);
+
+    if(k)
+        kfree(page2kva(k));
+    flush_tlb(pgdir);
+    return 0;
+}
+
+// Count a page fault handled since start, in rdtsc cycles, in the
+// latency histogram.
+// Caller must hold clock_algorithm_lock.
+static void
+fault_record(unsigned long long start)
+{
+    unsigned long long cycles;
+    int bucket;
+
+    cycles = (rdtsc() - start) >> FAULTHIST_LO;
+    for(bucket = 0; cycles && bucket < NFAULTHIST - 1; bucket++)
+        cycles >>= 1;
+    vmcount.fault_hist[bucket]++;
+}
+
+// Swap in the page at faddress if it was swapped out.  A page that
+// readahead already brought into the swap cache is mapped without
+// any I/O; otherwise it is read from disk and its neighbours are
+// read ahead.  The PTE's reference to the swap slot passes to the
+// frame, so that swap_out() can drop the page without a write while
+// it stays clean.  A page that came from the compressed pool gives
+// its slot up instead unless another process still shares it.
+
+// A write to a page merged by KSM gets a copy of it instead.
+// Returns 0 if the fault was handled, -1 if faddress is not a
+// swapped-out or merged page or there is no memory left for it.
+int page_fault_handle(
     unsigned int trap_no, unsigned int faddress, unsigned int *page_dir
 )
 {
@@ -235,171 +911,576 @@ void page_fault_handle(
     unsigned int* fault_entry = walkpgdir(
         page_dir, (void*)faddress, 0
     );
+    struct page* cached;
+    char* allocated_memory;
+    int slot, from_pool = 0;
+    unsigned long long start;
+
+    start = rdtsc();
+    if(fault_entry && (*fault_entry & PTE_P) && (*fault_entry & PTE_KSM)){
+        if(ksm_unshare(faddress, page_dir) < 0)
+            return -1;
+        acquire(&clock_algorithm_lock);
+        vmcount.minor_faults++;
+        fault_record(start);
+        release(&clock_algorithm_lock);
+        return 0;
+    }
+    if(!fault_entry || !(*fault_entry & PTE_SWAP))
+        return -1;
+
+    if((allocated_memory = kalloc()) == 0)
+        return -1;
+
+    acquiresleep(&paging_lock);
+    acquire(&clock_algorithm_lock);
+    if(!(*fault_entry & PTE_SWAP)){
+        release(&clock_algorithm_lock);
+        releasesleep(&paging_lock);
+        kfree(allocated_memory);
+        return 0;
+    }
+    slot = PTE_ADDR(*fault_entry) / PGSIZE;
+    if((cached = swap_cache_take(slot))){
+        swap_ra_hits++;
+        release(&clock_algorithm_lock);
+        kfree(allocated_memory);
+        allocated_memory = page2kva(cached);
+    }
+    else{
+        release(&clock_algorithm_lock);
+        from_pool = zswap_load(slot, allocated_memory) == 0;
+    }
+    if(!cached && !from_pool){
+        if(swapread(allocated_memory, slot) < 0){
+            // Nowhere to read the page from; mapping the frame
+            // would hand the process junk.
+            releasesleep(&paging_lock);
+            kfree(allocated_memory);
+            return -1;
+        }
 
-    if(*fault_entry&0x100){
-        char parity_check_value = parity_check();
-        
-        if(
-            !parity_check_value && !num_free_pages
-        ) panic("parity_check failed\n");
-        
-        char* allocated_memory = kalloc();
-        
-        if(allocated_memory){ // success
-            pages_valid_bits[*fault_entry / PGSIZE] = 0;
-            
-            memset(allocated_memory, 0, 4096);
-
-            *fault_entry = V2P(allocated_memory) |
-                (*fault_entry % PGSIZE - 0b11111111111);
-
-            pagelist_insertion((char*)faddress, 0, page_dir);
-            swapread(allocated_memory,*fault_entry/PGSIZE);
+        if(swap_ra_hits){
+            swap_ra_window *= 2;
+            if(swap_ra_window > SWAP_RA_MAX)
+                swap_ra_window = SWAP_RA_MAX;
         }
+        else if(swap_ra_window > 1)
+            swap_ra_window /= 2;
+        swap_ra_hits = 0;
+    }
+
+    acquire(&clock_algorithm_lock);
+    if(from_pool && slotinfo(slot)->refs == 1)
+        swap_free_slot(slot);
+    else
+        pa2page(V2P(allocated_memory))->swap_slot = slot;
+    *fault_entry = V2P(allocated_memory) |
+        (PTE_FLAGS(*fault_entry) & ~PTE_SWAP) | PTE_P | PTE_A;
+    pa2page(V2P(page_dir))->nswap--;
+    if(cached || from_pool)
+        vmcount.minor_faults++;
+    else{
+        vmcount.major_faults++;
+        vmcount.swapins++;
+        refault(0);
     }
+    fault_record(start);
+    release(&clock_algorithm_lock);
+    pagelist_insertion((char*)faddress, 0, page_dir);
+
+    if(!cached && !from_pool)
+        swap_readahead(faddress, page_dir);
+    releasesleep(&paging_lock);
+    return 0;
 }
 
-char parity_check()
+// Evict one anonymous page.  The clock hand sweeps the inactive
+// list.  A page found accessed (PTE_A) is marked PG_REFERENCED the
+// first time and promoted to the active list the second; the first
+// page found not accessed is evicted.  The active list is aged
+// whenever it outgrows the inactive one.  Returns 1 if a page was
+// freed, 0 otherwise.
+static int
+reclaim_anon(void)
 {
-    char return_value = 0;
-    char success = 1;
+    struct page* position;
+    pte_t* pte;
+    int scanned, freed = 0;
 
-    struct page* position = page_lru_head;
-    if(!num_lru_pages) return return_value;
+    acquiresleep(&paging_lock);
+    acquire(&clock_algorithm_lock);
+    // A page takes at most four visits to become evictable:
+    // marked, promoted, aged and demoted.
+    for(scanned = 0; scanned < 4 * num_lru_pages; scanned++){
+        vmcount.pages_scanned++;
+        if(!page_inactive_head ||
+           num_active_pages > num_lru_pages - num_active_pages){
+            lru_age();
+            continue;
+        }
+        position = page_inactive_head;
+        pte = walkpgdir(position->pgdir, (void*)position->vaddr, 0);
+        if(*pte & PTE_A){
+            *pte &= ~PTE_A;
+            if(position->flags & PG_REFERENCED){
+                lru_del(position);
+                position->flags = PG_ACTIVE;
+                lru_add(position);
+            }
+            else{
+                position->flags |= PG_REFERENCED;
+                page_inactive_head = position->next;
+            }
+            continue;
+        }
+        // swap_out() releases clock_algorithm_lock.
+        if((freed = swap_out(position)) != 0){
+            releasesleep(&paging_lock);
+            return freed > 0;
+        }
+        // The zswap pool took the frame: evict another.
+        acquire(&clock_algorithm_lock);
+    }
+    release(&clock_algorithm_lock);
+    releasesleep(&paging_lock);
+    return freed;
+}
 
-go_on:
+// Swap out the whole resident set of a process that has slept for
+// long, rather than leave the clock to strip it a page at a time
+// while busy processes fault.  Pages go in address order, so they
+// get consecutive swap slots and one sequential run of writes, and
+// swapin_all() can read them back the same way.  Page tables stay:
+// swapped-out PTEs hold the slots.  Returns 1 if a page was freed.
+static int
+reclaim_idle(void)
 {
-    unsigned int* pte = walkpgdir(
-        position->pgdir,
-        (void*)position->vaddr,
-        return_value
-    );
-    if((!(*pte&0x020)) && ((*pte&0x004))) 
-    {
-        swap_out(position);
-        return success;
-    }
-    if(page_lru_head != position->next){
-        position=position->next;
-        goto go_on;
-    }
-    else{
-        goto end_option;
-    }
-}
-end_option:
-{
-    position=page_lru_head;
-    char found=0;
-
-    int page_num;
-    char is_done = 0;
-
-    for(
-        page_num=0;
-        page_num<num_lru_pages;
-        page_num++
-    )
-    {
-        if(!is_done){
-            if(
-                (*walkpgdir(
-                    position->pgdir, (void*)position->vaddr, (int) return_value
-                )
-                &0x004)
-            ){
-                is_done = 1;
-                found=1;
+    struct proc *p;
+    struct page *pge;
+    pte_t *pte;
+    uint va;
+    int r, freed = 0;
+
+    if((p = idle_victim()) == 0)
+        return 0;
+    acquiresleep(&paging_lock);
+    for(va = 0; va < p->sz; va += PGSIZE){
+        acquire(&clock_algorithm_lock);
+        pte = walkpgdir(p->pgdir, (char*)va, 0);
+        if(pte && (*pte & PTE_P)){
+            pge = pa2page(PTE_ADDR(*pte));
+            if(pge->pgdir == p->pgdir && pge->vaddr == (char*)va &&
+               !(pge->flags & PG_LOCKED)){
+                // swap_out() releases clock_algorithm_lock.
+                if((r = swap_out(pge)) < 0)
+                    break;  // swap is full
+                acquire(&clock_algorithm_lock);
+                vmcount.idle_pages++;
+                release(&clock_algorithm_lock);
+                if(r > 0)
+                    freed = 1;
+                continue;
             }
-            position=position->next;
         }
+        release(&clock_algorithm_lock);
     }
-    char value_to_return;
-    if(!found){
-        value_to_return = return_value;
-    } 
-    else{
-        swap_out(position);
-        value_to_return = success;
+    releasesleep(&paging_lock);
+    idle_swapped(p);
+    if(freed){
+        acquire(&clock_algorithm_lock);
+        vmcount.idle_swapouts++;
+        release(&clock_algorithm_lock);
     }
-    return value_to_return;
+    return freed;
+}
+
+// Bring back the pages of the current process that reclaim_idle()
+// swapped out while it slept, SWAPIN_BATCH at a time.  The pages of
+// a batch that are only on disk are read back to back into the swap
+// cache, in one sequential pass over the slots reclaim_idle() gave
+// them, and then mapped by page_fault_handle() without further I/O.
+void
+swapin_all(void)
+{
+    struct proc *p = myproc();
+    char *mem[SWAPIN_BATCH];
+    int slot[SWAPIN_BATCH];
+    pte_t *pte;
+    uint va, end;
+    int i, n, full = 0;
+
+    p->swapstate = PS_RESIDENT;
+    va = 0;
+    while(va < p->sz && !full){
+        // Frames first: reclaim needs paging_lock.
+        n = 0;
+        for(end = va; end < p->sz && n < SWAPIN_BATCH; end += PGSIZE){
+            pte = walkpgdir(p->pgdir, (char*)end, 0);
+            if(!pte || !(*pte & PTE_SWAP))
+                continue;
+            slot[n] = PTE_ADDR(*pte) / PGSIZE;
+            if(slotinfo(slot[n])->cache || zswap_has(slot[n]))
+                continue;
+            if((mem[n] = kalloc()) == 0){
+                full = 1;
+                break;
+            }
+            n++;
+        }
+
+        acquiresleep(&paging_lock);
+        for(i = 0; i < n; i++){
+            if(swapread(mem[i], slot[i]) == 0){
+                acquire(&clock_algorithm_lock);
+                vmcount.swapins++;
+                if(swap_cache_add(slot[i], mem[i]))
+                    mem[i] = 0;
+                release(&clock_algorithm_lock);
+            }
+            if(mem[i])
+                kfree(mem[i]);
+        }
+        releasesleep(&paging_lock);
+
+        for(; va < end; va += PGSIZE){
+            pte = walkpgdir(p->pgdir, (char*)va, 0);
+            if(pte && (*pte & PTE_SWAP) &&
+               page_fault_handle(T_PGFLT, va, p->pgdir) < 0)
+                return;
+        }
     }
 }
 
+// Drop one page of the buffer cache.
+static int
+reclaim_file(void)
+{
+    if(!bshrink())
+        return 0;
+    acquire(&clock_algorithm_lock);
+    vmcount.file_drops++;
+    release(&clock_algorithm_lock);
+    return 1;
+}
+
+// Reclaim one page.  Unused readahead pages in the swap cache go
+// first, as they cost nothing to drop, then processes that have
+// been idle for long, whole.  Then clean buffer cache
+// pages, which cost at most a read to bring back, go before
+// anonymous pages, which may have to be written to swap.  While
+// file blocks refault more often than anonymous pages, though, the
+// file cache is too small for its working set, and anonymous pages
+// go first.  Returns 1 if a page was freed, 0 otherwise.
+char parity_check()
+{
+    char success = 1;
+    struct page* position;
+    int file_first;
+
+    acquire(&clock_algorithm_lock);
+    vmcount.reclaims++;
+    if((position = swap_cache_head) != 0){
+        swap_cache_take(position->swap_slot);
+        release(&clock_algorithm_lock);
+        kfree(page2kva(position));
+        return success;
+    }
+    file_first = file_refaults <= anon_refaults;
+    release(&clock_algorithm_lock);
 
-void swap_send(
+    if(reclaim_idle())
+        return success;
+    if(file_first && reclaim_file())
+        return success;
+    if(reclaim_anon())
+        return success;
+    if(!file_first && reclaim_file())
+        return success;
+    return 0;
+}
+
+// Give the child of fork() the swapped-out page at idx by sharing
+// the parent's swap slot.  Returns -1 if no page table can be
+// allocated in next_pgdir.
+int swap_send(
     unsigned int * page_dir, int next_offset, unsigned int * next_pgdir, int idx
 )
 {
-    char done = 0;
-    int j_idx;
-
     unsigned int* page_table_entry = walkpgdir(
         page_dir,
         (void*)idx,
         0
     );
-    int before_offset = *page_table_entry/PGSIZE;
-
-    for(j_idx=0; j_idx<PHYSTOP/4096; j_idx++)
-    {   
-        if (!j_idx) continue;
-        if(!pages_valid_bits[j_idx] && !done)
-        {
-            next_offset=j_idx;
-            done = 1;
-        }
-    }
-    mov_buff(before_offset,SWAPMAX,next_offset);
+    unsigned int* next_entry = walkpgdir(next_pgdir, (void*) idx, 1);
 
-    unsigned int* next_entry = walkpgdir(next_pgdir, (void*) idx, 0);
-    *next_entry= (*page_table_entry%PGSIZE)+(next_offset*PGSIZE);
-}
+    if(!next_entry)
+        return -1;
 
-void swap_out(struct page* pages_to_out)
-{  
-    int out_offset=0;
-    char done = 0;
-    int idx = 0;
+    acquire(&clock_algorithm_lock);
+    next_offset = *page_table_entry/PGSIZE;
+    slotinfo(next_offset)->refs++;
+    *next_entry = *page_table_entry;
+    pa2page(V2P(next_pgdir))->nswap++;
+    release(&clock_algorithm_lock);
+    return 0;
+}
 
-    acquire(&paging_lock);
+// Evict pages_to_out and free its frame.  A page that came from swap
+// keeps its slot; if PTE_D shows it was not written since, the copy
+// in the slot is still good and nothing is written.  Otherwise the
+// page is rewritten into its old slot if no one else shares it, or
+// into a fresh one, compressed into the zswap pool if it fits there
+// and written to disk if not.  Disk space is reserved up front, so
+// a page is only evicted if it has somewhere to go.
+// Called by parity_check() with paging_lock and clock_algorithm_lock
+// held; releases clock_algorithm_lock.
+// Returns the number of pages freed: 1, or 0 if the zswap pool kept
+// the frame as a pool page.  Returns -1, evicting nothing, if swap
+// space is full.
+int swap_out(struct page* pages_to_out)
+{
+    int out_offset;
+    int clean, stored = -1;
+    uint pa;
 
     unsigned int* pte = walkpgdir(
         pages_to_out->pgdir,
         (void*)pages_to_out->vaddr, 0
     );
 
-    for(
-        idx=1;
-        idx<PHYSTOP/PGSIZE;
-        idx++
-    ){
-        if (!idx) continue;
-        if(pages_valid_bits[idx]==0 && !done)
-        {
-            out_offset=idx;
-            done=1;
+    out_offset = pages_to_out->swap_slot;
+    clean = out_offset && !(*pte & PTE_D);
+    if(out_offset && !clean && slotinfo(out_offset)->refs > 1)
+        out_offset = 0;  // others still need the old contents
+    if(!out_offset && (out_offset = swap_alloc_slot()) == 0){
+        release(&clock_algorithm_lock);
+        return -1;
+    }
+    if(!clean && swap_reserve(out_offset) < 0){
+        if(out_offset != pages_to_out->swap_slot)
+            swap_free_slot(out_offset);
+        release(&clock_algorithm_lock);
+        return -1;
+    }
+    if(pages_to_out->swap_slot && out_offset != pages_to_out->swap_slot)
+        swap_free_slot(pages_to_out->swap_slot);
+
+    lru_del(pages_to_out);
+    pa2page(V2P(pages_to_out->pgdir))->rss--;
+    pa2page(V2P(pages_to_out->pgdir))->nswap++;
+
+    pa = PTE_ADDR(*pte);
+    *pte = (out_offset * PGSIZE) | PTE_SWAP |
+        (PTE_FLAGS(*pte) & ~(PTE_P | PTE_A | PTE_D));
+    flush_tlb(pages_to_out->pgdir);
+    pages_to_out->pgdir = 0;
+    pages_to_out->vaddr = 0;
+    pages_to_out->swap_slot = 0;
+    if(clean)
+        swap_clean_drops++;
+    release(&clock_algorithm_lock);
+
+    if(!clean && (stored = zswap_store(out_offset, P2V(pa), P2V(pa))) < 0){
+        swapwrite((char*)P2V(pa), out_offset);
+        acquire(&clock_algorithm_lock);
+        vmcount.swapouts++;
+        release(&clock_algorithm_lock);
+    }
+    else if(stored >= 0)
+        swap_release(out_offset);  // the pool holds it; free the disk space
+    // zswap_store() returns 1 when it kept the frame as a pool page.
+    if(stored == 1)
+        return 0;
+    kfree((char*)P2V(pa));
+    return 1;
+}
+
+// Lock (lock != 0) or unlock the user pages of pgdir in
+// [start, end).  Locked pages move to the unevictable list, out of
+// reach of parity_check(); swapped-out pages are brought in first.
+// Returns -1 if locking would take pgdir past MAXLOCKED pages, in
+// which case nothing changes, or if a page cannot be brought in.
+int mlock_range(pde_t *pgdir, uint start, uint end, int lock)
+{
+    struct page *pge, *dir = pa2page(V2P(pgdir));
+    pte_t *pte;
+    uint va;
+    int n = 0;
+
+    acquire(&clock_algorithm_lock);
+    for(va = start; lock && va < end; va += PGSIZE){
+        pte = walkpgdir(pgdir, (char*)va, 0);
+        if(pte && ((*pte & PTE_SWAP) || ((*pte & PTE_P) &&
+           !(pa2page(PTE_ADDR(*pte))->flags & (PG_LOCKED | PG_KSM)))))
+            n++;
+    }
+    if(dir->nlocked + n > MAXLOCKED){
+        release(&clock_algorithm_lock);
+        return -1;
+    }
+    release(&clock_algorithm_lock);
+
+    va = start;
+    while(va < end){
+        acquire(&clock_algorithm_lock);
+        pte = walkpgdir(pgdir, (char*)va, 0);
+        if(lock && pte && (*pte & PTE_SWAP)){
+            release(&clock_algorithm_lock);
+            if(page_fault_handle(T_PGFLT, va, pgdir) < 0)
+                return -1;
+            continue;  // it may be out again by now; look again
+        }
+        if(pte && (*pte & PTE_P)){
+            pge = pa2page(PTE_ADDR(*pte));
+            if(pge->pgdir == pgdir && pge->vaddr == (char*)va &&
+               ((pge->flags & PG_LOCKED) != 0) != (lock != 0)){
+                lru_del(pge);
+                pge->flags = lock ? PG_LOCKED : 0;
+                lru_add(pge);
+            }
         }
+        release(&clock_algorithm_lock);
+        va += PGSIZE;
     }
-    
-    pages_valid_bits[out_offset]=1;
-    
-    page_lru_head=pages_to_out->next;
-    num_lru_pages--;
+    return 0;
+}
 
+// Set or clear mlockall(MCL_FUTURE) for pgdir.
+void mlock_future(pde_t *pgdir, int on)
+{
+    struct page *dir = pa2page(V2P(pgdir));
 
-    pages_to_out->prev->next=pages_to_out->next;
-    pages_to_out->next->prev=pages_to_out->prev;
+    acquire(&clock_algorithm_lock);
+    if(on)
+        dir->flags |= PG_LOCKALL;
+    else
+        dir->flags &= ~PG_LOCKALL;
+    release(&clock_algorithm_lock);
+}
 
+// Move the user page old into the free frame mem, which takes
+// over its PTE and its place on the LRU list.
+// Caller must hold clock_algorithm_lock, and keep the owner of old
+// off the CPU with pgdir_hold().
+static void
+migrate_page(struct page *old, char *mem)
+{
+    struct page *pge = pa2page(V2P(mem));
+    struct page **head;
+    pte_t *pte = walkpgdir(old->pgdir, old->vaddr, 0);
 
-    swapwrite((char*)P2V(
-        PTE_ADDR((out_offset*PGSIZE)| 0x100 |(*pte%PGSIZE-1))
-    ),out_offset);
-    kfree((char*)P2V(PTE_ADDR(
-        (out_offset*PGSIZE)| 0x100 |(*pte%PGSIZE-1)
-    )));
+    memmove(mem, page2kva(old), PGSIZE);
+    pge->pgdir = old->pgdir;
+    pge->vaddr = old->vaddr;
+    pge->swap_slot = old->swap_slot;
+    pge->csum = old->csum;
+    pge->flags = old->flags;
 
-    release(&paging_lock);
+    head = (old->flags & PG_ACTIVE) ? &page_active_head : &page_inactive_head;
+    if(old->next == old){
+        pge->next = pge;
+        pge->prev = pge;
+    }
+    else{
+        pge->next = old->next;
+        pge->prev = old->prev;
+        old->prev->next = pge;
+        old->next->prev = pge;
+    }
+    if(*head == old)
+        *head = pge;
+
+    *pte = V2P(mem) | PTE_FLAGS(*pte);
+    flush_tlb(pge->pgdir);
+    old->next = 0;
+    old->prev = 0;
+    old->pgdir = 0;
+    old->vaddr = 0;
+    old->swap_slot = 0;
+}
 
+// Whether pge, the frame at pfn, is a user page compact() may move.
+// Caller must hold clock_algorithm_lock.
+static int
+movable(struct page *pge, uint pfn)
+{
+    pte_t *pte;
+
+    if(pge->pgdir == 0 || pge->next == 0 ||
+       (pge->flags & (PG_LOCKED | PG_KSM | PG_FREE)))
+        return 0;
+    pte = walkpgdir(pge->pgdir, pge->vaddr, 0);
+    return pte && (*pte & PTE_P) && PTE_ADDR(*pte) == pfn * PGSIZE;
 }
 
+// Compact physical memory.  One scanner goes up from the bottom of
+// memory looking for user pages on the LRU lists, another down from
+// the top looking for free frames, and each page found is moved to
+// the next free frame, until the two meet.  The free frames left
+// behind at the bottom then run together into large blocks.
+// Locked and merged pages stay where they are, and so do pages of
+// processes that cannot be held off the CPU by pgdir_hold(): the
+// owner must not write to the old frame while it is copied, nor
+// through a stale TLB entry after.
+// Returns the number of pages moved.
+int
+compact(void)
+{
+    struct page *pge;
+    struct proc *owner;
+    pde_t *pgdir;
+    char *mem;
+    uint lo, hi;
+    int moved = 0;
+
+    // Keep reclaim, and so swap_out(), away while pages move.
+    acquiresleep(&paging_lock);
+    lo = 0;
+    hi = NPAGES - 1;
+    for(; lo < hi; lo++){
+        acquire(&clock_algorithm_lock);
+        pge = &pages[lo];
+        pgdir = pge->pgdir;
+        if(!movable(pge, lo)){
+            release(&clock_algorithm_lock);
+            continue;
+        }
+        // ptable.lock comes before clock_algorithm_lock.
+        release(&clock_algorithm_lock);
+        if((owner = pgdir_hold(pgdir)) == 0)
+            continue;
+
+        acquire(&clock_algorithm_lock);
+        if(pge->pgdir != pgdir || !movable(pge, lo)){
+            release(&clock_algorithm_lock);
+            ksm_unhold(owner);
+            continue;
+        }
+        mem = 0;
+        acquire(&kmem.lock);
+        for(; lo < hi; hi--){
+            if(pages[hi].flags & PG_FREE){
+                mem = take_page(hi--);
+                break;
+            }
+        }
+        release(&kmem.lock);
+        if(mem == 0){
+            release(&clock_algorithm_lock);
+            ksm_unhold(owner);
+            break;
+        }
+        migrate_page(pge, mem);
+        release(&clock_algorithm_lock);
+        ksm_unhold(owner);
+        kfree(P2V(lo * PGSIZE));
+        moved++;
+    }
+    acquire(&clock_algorithm_lock);
+    vmcount.compact_runs++;
+    vmcount.compact_moved += moved;
+    release(&clock_algorithm_lock);
+    releasesleep(&paging_lock);
+    return moved;
+}
@@ -0,0 +1,39 @@
+// ksmd: merge identical pages of all processes, in the background.
+//   ksmd [-n pages] [-t ticks] &
+// Every ticks (default 20) ticks, has the kernel look through pages
+// (default 256) more user pages and merge those with the same
+// contents into one copy-on-write frame.  Merging is off until
+// ksmd runs; vmstat reports what it saved.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+int
+main(int argc, char *argv[])
+{
+  int i, npages, nticks;
+
+  npages = 256;
+  nticks = 20;
+  for(i = 1; i + 1 < argc; i += 2){
+    if(strcmp(argv[i], "-n") == 0)
+      npages = atoi(argv[i+1]);
+    else if(strcmp(argv[i], "-t") == 0)
+      nticks = atoi(argv[i+1]);
+    else
+      break;
+  }
+  if(i != argc || npages <= 0 || nticks <= 0){
+    printf(2, "Usage: ksmd [-n pages] [-t ticks]\n");
+    exit();
+  }
+
+  for(;;){
+    if(ksmscan(npages) < 0){
+      printf(2, "ksmd: ksmscan failed\n");
+      exit();
+    }
+    sleep(nticks);
+  }
+}
@@ -227,3 +227,20 @@ cmostime(struct rtcdate *r)
   *r = t1;
   r->year += 2000;
 }
+
+// Top of physical memory, as the BIOS leaves it in CMOS: 64KB
+// units above 16MB, or for smaller machines 1KB units above 1MB.
+// Never above PHYSTOP, which is all the kernel maps.
+uint
+memtop(void)
+{
+  uint n, top;
+
+  if((n = cmos_read(0x34) | cmos_read(0x35) << 8) != 0)
+    top = 16*1024*1024 + n*64*1024;
+  else
+    top = 1024*1024 + (cmos_read(0x30) | cmos_read(0x31) << 8)*1024;
+  if(top > PHYSTOP)
+    top = PHYSTOP;
+  return PGROUNDDOWN(top);
+}
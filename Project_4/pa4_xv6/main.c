@@ -29,10 +29,12 @@ main(void)
   pinit();         // process table
   tvinit();        // trap vectors
   binit();         // buffer cache
+  zswapinit();     // compressed swap pool
   fileinit();      // file table
   ideinit();       // disk 
+  swapinit();      // swap areas
   startothers();   // start other processors
-  kinit2(P2V(4*1024*1024), P2V(PHYSTOP)); // must come after startothers()
+  kinit2(P2V(4*1024*1024), P2V(memtop())); // must come after startothers()
   userinit();      // first user process
   mpmain();        // finish this processor's setup
 }
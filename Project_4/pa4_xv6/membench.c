@@ -0,0 +1,303 @@
+// membench: measure paging under memory pressure.
+//
+//   membench [-m percent] [-w workers] [-n accesses] [phase...]
+//
+// The workers (default 2) share percent% (default 150) of physical
+// memory between them.  After allocating their pages they run the
+// phases together, each phase starting when every worker has
+// finished the last.  Every worker writes one word per access:
+//   seq    sequential passes over its pages
+//   rand   pages picked uniformly at random
+//   zipf   pages picked with Zipfian (s = 1) popularity
+//   shift  a working set of a quarter of its pages, moving on by
+//          half its size every eighth of the phase
+// A phase makes accesses (default twice the worker's pages) per
+// worker.  Each phase reports elapsed time, throughput, faults and
+// swap I/O.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "vmstat.h"
+#include "zswap.h"
+
+#define PGSIZE     4096
+#define MAXWORKERS 8
+
+char *phasenames[] = { "seq", "rand", "zipf", "shift" };
+#define NPHASES (sizeof(phasenames)/sizeof(phasenames[0]))
+
+int phases[NPHASES];
+int nphases;
+
+char *mem;
+int npages, naccess;
+uint seed;
+uint *zipfcdf;
+
+static uint
+rand(void)
+{
+  // xorshift32
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+  return seed;
+}
+
+static void
+touch(int page)
+{
+  ((int*)(mem + page*PGSIZE))[rand() % (PGSIZE/sizeof(int))]++;
+}
+
+// Cumulative weights 2^16/rank for ranks 1..npages.
+static int
+zipfinit(void)
+{
+  int k;
+
+  if((zipfcdf = malloc(npages * sizeof(uint))) == 0)
+    return -1;
+  for(k = 0; k < npages; k++)
+    zipfcdf[k] = (k ? zipfcdf[k-1] : 0) + (1 << 16) / (k + 1);
+  return 0;
+}
+
+// Pick a page with Zipfian popularity.  Ranks are spread over the
+// pages so that the hot ones are not all next to each other.
+static int
+zipf(void)
+{
+  uint r;
+  int lo, hi, mid, stride;
+
+  r = rand() % zipfcdf[npages-1];
+  lo = 0;
+  hi = npages - 1;
+  while(lo < hi){
+    mid = (lo + hi) / 2;
+    if(zipfcdf[mid] > r)
+      hi = mid;
+    else
+      lo = mid + 1;
+  }
+  stride = npages % 7919 ? 7919 : 7907;
+  return (uint)lo * stride % npages;
+}
+
+static void
+runphase(int phase)
+{
+  int i, ws, step, base;
+
+  switch(phase){
+  case 0:
+    for(i = 0; i < naccess; i++)
+      touch(i % npages);
+    break;
+  case 1:
+    for(i = 0; i < naccess; i++)
+      touch(rand() % npages);
+    break;
+  case 2:
+    for(i = 0; i < naccess; i++)
+      touch(zipf());
+    break;
+  case 3:
+    ws = npages / 4 ? npages / 4 : 1;
+    step = naccess / 8 ? naccess / 8 : 1;
+    base = 0;
+    for(i = 0; i < naccess; i++){
+      if(i && i % step == 0)
+        base = (base + (ws+1) / 2) % npages;
+      touch((base + rand() % ws) % npages);
+    }
+    break;
+  }
+}
+
+// Allocate, say so on done, then run each phase when told to on go.
+static void
+worker(int go, int done)
+{
+  char c;
+  int i;
+
+  seed = getpid() * 2654435761U | 1;
+  mem = sbrk(npages*PGSIZE + PGSIZE);
+  if(mem == (char*)-1 || zipfinit() < 0){
+    write(done, "x", 1);
+    exit();
+  }
+  mem = (char*)(((uint)mem + PGSIZE-1) & ~(PGSIZE-1));
+  write(done, "r", 1);
+  for(i = 0; i < nphases; i++){
+    if(read(go, &c, 1) != 1)
+      break;
+    runphase(phases[i]);
+    write(done, "d", 1);
+  }
+  exit();
+}
+
+struct sample {
+  int ticks;
+  int rdsect, wrsect;
+  struct vmstat vm;
+};
+
+static void
+sample(struct sample *s)
+{
+  s->ticks = uptime();
+  swapstat(&s->rdsect, &s->wrsect);
+  vmstat(&s->vm);
+}
+
+static void
+report(char *name, int accesses, struct sample *a, struct sample *b)
+{
+  int ticks = b->ticks - a->ticks;
+
+  printf(1, "%s\t%d\t%d\t%d\t%d\t%d\t%d\t%d\t%d\n", name, ticks * 10,
+         accesses / (ticks ? ticks : 1) * 100,
+         b->vm.minor_faults - a->vm.minor_faults,
+         b->vm.major_faults - a->vm.major_faults,
+         b->vm.swapins - a->vm.swapins,
+         b->vm.swapouts - a->vm.swapouts,
+         b->rdsect - a->rdsect, b->wrsect - a->wrsect);
+}
+
+// Wait for one byte from each worker.  Returns -1 if one failed.
+static int
+waitall(int done, int nworkers)
+{
+  char c;
+  int i;
+
+  for(i = 0; i < nworkers; i++)
+    if(read(done, &c, 1) != 1 || c == 'x')
+      return -1;
+  return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct sample start, a, b;
+  struct zswapstat z;
+  int percent, nworkers, phys, i, j, go[MAXWORKERS], gp[2], p[2], done;
+
+  percent = 150;
+  nworkers = 2;
+  naccess = 0;
+  for(i = 1; i < argc; i++){
+    if(argv[i][0] != '-'){
+      for(j = 0; j < NPHASES && strcmp(argv[i], phasenames[j]); j++)
+        ;
+      if(j == NPHASES || nphases == NPHASES)
+        goto usage;
+      phases[nphases++] = j;
+    } else if(i + 1 == argc)
+      goto usage;
+    else if(strcmp(argv[i], "-m") == 0)
+      percent = atoi(argv[++i]);
+    else if(strcmp(argv[i], "-w") == 0)
+      nworkers = atoi(argv[++i]);
+    else if(strcmp(argv[i], "-n") == 0)
+      naccess = atoi(argv[++i]);
+    else
+      goto usage;
+  }
+  if(percent <= 0 || nworkers <= 0 || nworkers > MAXWORKERS || naccess < 0)
+    goto usage;
+  if(nphases == 0)
+    for(nphases = 0; nphases < NPHASES; nphases++)
+      phases[nphases] = nphases;
+
+  sample(&start);
+  phys = start.vm.free_pages + start.vm.active_pages +
+         start.vm.inactive_pages + start.vm.locked_pages +
+         start.vm.swapcache_pages;
+  npages = phys / 100 * percent / nworkers;
+  if(npages == 0)
+    npages = 1;
+  if(naccess == 0)
+    naccess = 2 * npages;
+  printf(1, "membench: %d workers x %d pages (%d%% of %d), "
+         "%d accesses per phase\n",
+         nworkers, npages, percent, phys, naccess);
+
+  if(pipe(p) < 0){
+    printf(2, "membench: pipe failed\n");
+    exit();
+  }
+  done = p[0];
+  for(i = 0; i < nworkers; i++){
+    if(pipe(gp) < 0){
+      printf(2, "membench: pipe failed\n");
+      exit();
+    }
+    j = fork();
+    if(j < 0){
+      printf(2, "membench: fork failed\n");
+      exit();
+    }
+    if(j == 0){
+      close(done);
+      close(gp[1]);
+      worker(gp[0], p[1]);
+    }
+    close(gp[0]);
+    go[i] = gp[1];
+  }
+  close(p[1]);
+  printf(1, "phase\tms\tacc/s\tminflt\tmajflt\tswapin\tswapout"
+         "\trdsect\twrsect\n");
+  if(waitall(done, nworkers) < 0){
+    printf(2, "membench: worker could not allocate its pages\n");
+    goto out;
+  }
+  sample(&a);
+  report("alloc", npages * nworkers, &start, &a);
+  b = a;
+
+  for(i = 0; i < nphases; i++){
+    sample(&a);
+    for(j = 0; j < nworkers; j++)
+      write(go[j], "g", 1);
+    if(waitall(done, nworkers) < 0)
+      break;
+    sample(&b);
+    report(phasenames[phases[i]], naccess * nworkers, &a, &b);
+  }
+
+  printf(1, "page fault latency, cycles:\n");
+  for(i = 0; i < NFAULTHIST; i++){
+    j = b.vm.fault_hist[i] - start.vm.fault_hist[i];
+    if(j == 0)
+      continue;
+    if(i < NFAULTHIST - 1)
+      printf(1, "  < 2^%d\t%d\n", FAULTHIST_LO + i, j);
+    else
+      printf(1, " >= 2^%d\t%d\n", FAULTHIST_LO + i - 1, j);
+  }
+  if(zswapstat(&z) == 0)
+    printf(1, "zswap: %d pages in %d pool pages; %d stores, %d hits, "
+           "%d written back\n",
+           z.stored_pages, z.pool_pages, z.stores, z.hits, z.writebacks);
+
+out:
+  for(j = 0; j < nworkers; j++)
+    close(go[j]);
+  for(i = 0; i < nworkers; i++)
+    wait();
+  printf(1, "membench: done\n");
+  exit();
+
+usage:
+  printf(2, "Usage: membench [-m percent] [-w workers] [-n accesses] "
+         "[seq|rand|zipf|shift]...\n");
+  exit();
+}
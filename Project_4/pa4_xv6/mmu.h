@@ -94,7 +94,11 @@ struct segdesc {
 #define PTE_P           0x001   // Present
 #define PTE_W           0x002   // Writeable
 #define PTE_U           0x004   // User
+#define PTE_A           0x020   // Accessed
+#define PTE_D           0x040   // Dirty
 #define PTE_PS          0x080   // Page Size
+#define PTE_SWAP        0x100   // Swapped out; PTE_ADDR holds the swap slot
+#define PTE_KSM         0x200   // Writeable, but the frame is shared by KSM
 
 // Address in page table or page directory entry
 #define PTE_ADDR(pte)   ((uint)(pte) & ~0xFFF)
@@ -182,9 +186,32 @@ struct page{
 	struct page *next;
 	struct page *prev;
 	pde_t *pgdir;
-	char *vaddr;
+	int flags;
+	union {
+		struct {	// user pages
+			char *vaddr;
+			int swap_slot;	// swap cache: slot this frame holds a copy of
+			uint csum;	// contents when KSM last looked
+		};
+		struct {	// page directories: pages of the address space
+			int rss;	// resident
+			int nswap;	// swapped out
+			int nlocked;	// mlock()ed
+		};
+		struct {	// KSM pages; csum still holds their checksum
+			int mapcount;	// PTEs that map it
+		};
+	};
 };
 
+// struct page flags
+#define PG_ACTIVE	0x001	// on the active LRU list
+#define PG_REFERENCED	0x002	// accessed once on the inactive list
+#define PG_LOCKED	0x004	// mlock()ed: on the unevictable list
+#define PG_LOCKALL	0x008	// page directory: mlockall(MCL_FUTURE)
+#define PG_KSM		0x010	// merged by KSM: shared read-only, on no LRU list
+#define PG_FREE		0x020	// on the free list
+
 
 
 #endif
@@ -7,10 +7,14 @@
 #define NDEV         10  // maximum major device number
 #define ROOTDEV       1  // device number of file system root disk
 #define MAXARG       32  // max exec arguments
+#define MAXPATH     128  // maximum file path name
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
 #define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
 #define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
 #define FSSIZE       100000  // size of file system in blocks
-#define SWAPBASE	500
-#define SWAPMAX		(100000 - SWAPBASE)
+#define SWAPBASE	500    // boot disk swap area starts here
+#define MAXLOCKED    1024  // most pages a process may mlock()
+#define IDLESWAP     2000  // ticks asleep before a process is swapped out whole
+#define MCL_CURRENT   0x1  // mlockall(): lock pages mapped now
+#define MCL_FUTURE    0x2  // mlockall(): lock pages as they are mapped
 
@@ -13,8 +13,6 @@ struct {
 } ptable;
 
 static struct proc *initproc;
-extern struct spinlock paging_lock;
-extern struct spinlock clock_algorithm_lock;
 
 int nextpid = 1;
 extern void forkret(void);
@@ -90,6 +88,7 @@ allocproc(void)
 found:
   p->state = EMBRYO;
   p->pid = nextpid++;
+  p->swapstate = PS_RESIDENT;
 
   release(&ptable.lock);
 
@@ -150,15 +149,7 @@ userinit(void)
   // because the assignment might not be atomic.
   acquire(&ptable.lock);
 
-  initlock(
-    &clock_algorithm_lock,
-    "clock_algorithm"
-  );
   p->state = RUNNABLE;
-  initlock(
-    &paging_lock,
-    "paging"
-  );
 
   release(&ptable.lock);
 }
@@ -257,6 +248,10 @@ exit(void)
   end_op();
   curproc->cwd = 0;
 
+  // Give back user memory now rather than in wait(), so that
+  // a process killed for memory frees it at once.
+  deallocuvm(curproc->pgdir, KERNBASE, 0);
+
   acquire(&ptable.lock);
 
   // Parent might be sleeping in wait().
@@ -343,7 +338,8 @@ scheduler(void)
     // Loop over process table looking for process to run.
     acquire(&ptable.lock);
     for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-      if(p->state != RUNNABLE)
+      if(p->state != RUNNABLE || p->swapstate == PS_SWAPPING ||
+         p->swapstate == PS_MERGING)
         continue;
 
       // Switch to chosen process.  It is the process's job
@@ -448,6 +444,7 @@ sleep(void *chan, struct spinlock *lk)
   // Go to sleep.
   p->chan = chan;
   p->state = SLEEPING;
+  p->sleeptick = ticks;
 
   sched();
 
@@ -512,6 +509,135 @@ kill(int pid)
   return -1;
 }
 
+// Out of memory: kill the process using the most of it, counting
+// both resident and swapped-out pages, and return it.  If a process
+// killed earlier has not exited yet, return it instead of killing
+// another.  Never kills init.  Returns 0 if there is no victim.
+struct proc*
+oom_kill(void)
+{
+  struct proc *p, *victim;
+  int rss, nswap, nlocked, points, best;
+
+  victim = 0;
+  best = 0;
+  acquire(&ptable.lock);
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+    if(p == initproc || p->pgdir == 0 ||
+       p->state == UNUSED || p->state == EMBRYO || p->state == ZOMBIE)
+      continue;
+    pgdir_usage(p->pgdir, &rss, &nswap, &nlocked);
+    points = rss + nswap;
+    if(p->killed && points > 0){
+      release(&ptable.lock);
+      return p;
+    }
+    if(points > best){
+      best = points;
+      victim = p;
+    }
+  }
+  if(victim){
+    pgdir_usage(victim->pgdir, &rss, &nswap, &nlocked);
+    cprintf("oom: killed pid %d (%s): %d resident, %d swapped pages\n",
+            victim->pid, victim->name, rss, nswap);
+    victim->killed = 1;
+    if(victim->state == SLEEPING)
+      victim->state = RUNNABLE;
+  }
+  release(&ptable.lock);
+  return victim;
+}
+
+// Pick the process that has slept longest, if that is at least
+// IDLESWAP ticks, for reclaim to swap out whole.  It is marked
+// PS_SWAPPING, so it will not run, and its memory stays put, until
+// idle_swapped() is called.  Returns 0 if there is none.
+struct proc*
+idle_victim(void)
+{
+  struct proc *p, *victim;
+  int rss, nswap, nlocked;
+
+  victim = 0;
+  acquire(&ptable.lock);
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+    if(p->state != SLEEPING || p->swapstate != PS_RESIDENT ||
+       ticks - p->sleeptick < IDLESWAP)
+      continue;
+    pgdir_usage(p->pgdir, &rss, &nswap, &nlocked);
+    if(rss > nlocked && (victim == 0 || p->sleeptick < victim->sleeptick))
+      victim = p;
+  }
+  if(victim)
+    victim->swapstate = PS_SWAPPING;
+  release(&ptable.lock);
+  return victim;
+}
+
+void
+idle_swapped(struct proc *p)
+{
+  acquire(&ptable.lock);
+  p->swapstate = PS_SWAPPED;
+  release(&ptable.lock);
+}
+
+// Hold the lowest-numbered process with a pid of at least pid that
+// is not running, for ksm_scan() to look through its pages.  It is
+// marked PS_MERGING, which keeps it off the CPU, so that its page
+// tables stay put and no TLB holds a stale writeable mapping, until
+// ksm_unhold() is called.  Returns 0 if there is none.
+struct proc*
+ksm_hold(int pid)
+{
+  struct proc *p, *held;
+
+  held = 0;
+  acquire(&ptable.lock);
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+    if((p->state != SLEEPING && p->state != RUNNABLE) ||
+       p->swapstate != PS_RESIDENT || p->pid < pid)
+      continue;
+    if(held == 0 || p->pid < held->pid)
+      held = p;
+  }
+  if(held)
+    held->swapstate = PS_MERGING;
+  release(&ptable.lock);
+  return held;
+}
+
+// Hold the process whose address space is pgdir the same way, for
+// compact() to move one of its pages.  Returns 0 if it is running,
+// already held, or not a process's address space yet.
+struct proc*
+pgdir_hold(pde_t *pgdir)
+{
+  struct proc *p, *held;
+
+  held = 0;
+  acquire(&ptable.lock);
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+    if(p->pgdir == pgdir && (p->state == SLEEPING || p->state == RUNNABLE) &&
+       p->swapstate == PS_RESIDENT){
+      held = p;
+      held->swapstate = PS_MERGING;
+      break;
+    }
+  }
+  release(&ptable.lock);
+  return held;
+}
+
+void
+ksm_unhold(struct proc *p)
+{
+  acquire(&ptable.lock);
+  p->swapstate = PS_RESIDENT;
+  release(&ptable.lock);
+}
+
 //PAGEBREAK: 36
 // Print a process listing to console.  For debugging.
 // Runs when user types ^P on console.
@@ -531,6 +657,7 @@ procdump(void)
   struct proc *p;
   char *state;
   uint pc[10];
+  int rss, nswap, nlocked;
 
   for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
     if(p->state == UNUSED)
@@ -540,6 +667,10 @@ procdump(void)
     else
       state = "???";
     cprintf("%d %s %s", p->pid, state, p->name);
+    if(p->pgdir){
+      pgdir_usage(p->pgdir, &rss, &nswap, &nlocked);
+      cprintf(" rss %d swap %d locked %d", rss, nswap, nlocked);
+    }
     if(p->state == SLEEPING){
       getcallerpcs((uint*)p->context->ebp+2, pc);
       for(i=0; i<10 && pc[i] != 0; i++)
@@ -49,8 +49,16 @@ struct proc {
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
+  uint sleeptick;              // When it last went to sleep
+  int swapstate;               // PS_RESIDENT, PS_SWAPPING, ...
 };
 
+// Whole-process swapping of long-idle processes (see reclaim_idle()).
+#define PS_RESIDENT 0  // pages come and go one at a time
+#define PS_SWAPPING 1  // resident set being swapped out; do not run
+#define PS_SWAPPED  2  // resident set swapped out; bring back on return to user
+#define PS_MERGING  3  // pages being scanned by KSM; do not run
+
 // Process memory is laid out contiguously, low addresses first:
 //   text
 //   original data and bss
@@ -0,0 +1,399 @@
+// Swap areas.
+//
+// Swap space is made of up to NSWAPAREA areas.  swapon() adds a whole
+// IDE disk, named by a device file of major DISK.  swapinit() adds
+// the part of the boot disk past the kernel, from block SWAPBASE to
+// its end.  There are no swap files: a file of MAXFILE blocks would
+// hold only a few pages.
+//
+// Pages are named by swap slot (see kalloc.c).  A slot whose page is
+// on disk has a location: an area and a page offset within it.
+// Locations come from the highest-priority areas with free space,
+// rotating among areas of equal priority so that pages are striped
+// across them.  PTEs hold only the slot, so swapoff() can move the
+// pages of an area elsewhere without finding the page tables that
+// refer to them.
+//
+// The state of each slot is a struct swapslot.  The table of them
+// is allocated a page at a time as areas are added, to one slot per
+// page of swap space plus POOLSLOTS for pages that are only in the
+// compressed pool; it does not shrink when an area is removed.
+// Each area uses at most MAXPAGES pages, as many as one page of map
+// tracks.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "stat.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "swap.h"
+
+#define NSWAPAREA   8
+#define BLKS_PER_PG (PGSIZE / BSIZE)
+#define MAXPAGES    (PGSIZE * 8)    // pages one map page can track
+#define POOLSLOTS   8192            // slots beyond the areas' pages
+#define MAXSLOTS    (1 + POOLSLOTS + NSWAPAREA * MAXPAGES)
+#define SLOTS_PER_PG (PGSIZE / sizeof(struct swapslot))
+
+struct swaparea {
+  int used;
+  int draining;          // swapoff() in progress; no new pages
+  int prio;
+  uint dev;
+  uint start;            // first block
+  int npages;
+  int nfree;
+  int hint;              // where to look for a free page next
+  uchar *map;            // one bit per page in use
+};
+
+struct {
+  struct spinlock lock;
+  struct swaparea area[NSWAPAREA];
+  int rotor;             // area that took the last page
+} swap;
+
+// Pages of the slot table.  Slots 1 to nswapslots-1 exist; slot 0
+// is never used.  Both only grow, nswapslots under
+// clock_algorithm_lock.
+static struct swapslot *slottab[(MAXSLOTS + SLOTS_PER_PG - 1) / SLOTS_PER_PG];
+int nswapslots;
+
+int nr_sectors_read;
+int nr_sectors_write;
+
+extern struct sleeplock paging_lock;
+extern struct spinlock clock_algorithm_lock;
+static char swap_bounce[PGSIZE];  // protected by paging_lock
+
+struct swapslot*
+slotinfo(int slot)
+{
+  return &slottab[slot / SLOTS_PER_PG][slot % SLOTS_PER_PG];
+}
+
+// Make the slot table n slots long, or as long as memory allows.
+static void
+slot_grow(int n)
+{
+  int i;
+  char *mem;
+
+  if(n > MAXSLOTS)
+    n = MAXSLOTS;
+  for(i = 0; i * SLOTS_PER_PG < n; i++){
+    if(slottab[i])
+      continue;
+    if((mem = kalloc()) == 0){
+      n = i * SLOTS_PER_PG;
+      cprintf("swap: only %d slots\n", n - 1);
+      break;
+    }
+    memset(mem, 0, PGSIZE);
+    acquire(&swap.lock);
+    if(slottab[i] == 0){
+      slottab[i] = (struct swapslot*)mem;
+      mem = 0;
+    }
+    release(&swap.lock);
+    if(mem)
+      kfree(mem);
+  }
+  acquire(&clock_algorithm_lock);
+  if(n > nswapslots)
+    nswapslots = n;
+  release(&clock_algorithm_lock);
+}
+
+// Add an area.  Returns 0 on success, -1 if there is no room.
+static int
+area_add(uint dev, uint start, int npages, int prio)
+{
+  struct swaparea *sa;
+  uchar *map;
+
+  if(npages <= 0)
+    return -1;
+  if(npages > MAXPAGES)
+    npages = MAXPAGES;
+  if((map = (uchar*)kalloc()) == 0)
+    return -1;
+  memset(map, 0, PGSIZE);
+
+  acquire(&swap.lock);
+  for(sa = swap.area; sa < &swap.area[NSWAPAREA]; sa++){
+    if(sa->used)
+      continue;
+    sa->used = 1;
+    sa->draining = 0;
+    sa->prio = prio;
+    sa->dev = dev;
+    sa->start = start;
+    sa->npages = npages;
+    sa->nfree = npages;
+    sa->hint = 0;
+    sa->map = map;
+    npages = 0;
+    for(sa = swap.area; sa < &swap.area[NSWAPAREA]; sa++)
+      if(sa->used)
+        npages += sa->npages;
+    release(&swap.lock);
+    slot_grow(1 + POOLSLOTS + npages);
+    return 0;
+  }
+  release(&swap.lock);
+  kfree((char*)map);
+  return -1;
+}
+
+void
+swapinit(void)
+{
+  initlock(&swap.lock, "swap");
+  slot_grow(1 + POOLSLOTS);
+  if(area_add(0, SWAPBASE, (int)(idesize(0) - SWAPBASE) / BLKS_PER_PG,
+              -1) < 0)
+    cprintf("swapinit: no swap on boot disk\n");
+}
+
+// Disk block of block i of page off in area sa.
+static uint
+area_block(struct swaparea *sa, int off, int i)
+{
+  return sa->start + off * BLKS_PER_PG + i;
+}
+
+// Give slot a place on disk if it does not have one.
+// Returns 0 on success, -1 if all areas are full.
+int
+swap_reserve(int slot)
+{
+  struct swapslot *ss;
+  struct swaparea *sa, *best;
+  int i, n, off;
+
+  ss = slotinfo(slot);
+  acquire(&swap.lock);
+  if(ss->loc){
+    release(&swap.lock);
+    return 0;
+  }
+  // Highest priority first; among equals, the one after the
+  // area that took the last page.
+  best = 0;
+  for(n = 1; n <= NSWAPAREA; n++){
+    i = (swap.rotor + n) % NSWAPAREA;
+    sa = &swap.area[i];
+    if(!sa->used || sa->draining || sa->nfree == 0)
+      continue;
+    if(best == 0 || sa->prio > best->prio)
+      best = sa;
+  }
+  if(best == 0){
+    release(&swap.lock);
+    return -1;
+  }
+  for(;;){  // nfree > 0, so some page is free
+    off = best->hint;
+    if(++best->hint == best->npages)
+      best->hint = 0;
+    if((best->map[off/8] & (1 << (off%8))) == 0)
+      break;
+  }
+  best->map[off/8] |= 1 << (off%8);
+  best->nfree--;
+  swap.rotor = best - swap.area;
+  ss->loc = (swap.rotor + 1) << 16 | off;
+  release(&swap.lock);
+  return 0;
+}
+
+// Free the place on disk of slot, if it has one.
+void
+swap_release(int slot)
+{
+  struct swapslot *ss;
+  struct swaparea *sa;
+  int off;
+
+  ss = slotinfo(slot);
+  acquire(&swap.lock);
+  if(ss->loc){
+    sa = &swap.area[(ss->loc >> 16) - 1];
+    off = ss->loc & 0xffff;
+    sa->map[off/8] &= ~(1 << (off%8));
+    sa->nfree++;
+    ss->loc = 0;
+  }
+  release(&swap.lock);
+}
+
+// Report the pages of swap disk space in all areas and how many
+// of them are free.
+void
+swap_usage(int *total, int *nfree)
+{
+  struct swaparea *sa;
+
+  *total = *nfree = 0;
+  acquire(&swap.lock);
+  for(sa = swap.area; sa < &swap.area[NSWAPAREA]; sa++){
+    if(sa->used){
+      *total += sa->npages;
+      *nfree += sa->nfree;
+    }
+  }
+  release(&swap.lock);
+}
+
+// Find the area and offset of slot.  Returns 0 if it has none.
+static struct swaparea*
+swap_locate(int slot, int *off)
+{
+  struct swapslot *ss;
+  struct swaparea *sa;
+
+  if(slot <= 0 || slot >= nswapslots)
+    return 0;
+  ss = slotinfo(slot);
+  acquire(&swap.lock);
+  if(ss->loc == 0){
+    release(&swap.lock);
+    return 0;
+  }
+  sa = &swap.area[(ss->loc >> 16) - 1];
+  *off = ss->loc & 0xffff;
+  release(&swap.lock);
+  return sa;
+}
+
+// Read the page of slot into ptr.  Returns -1 if it is not on disk.
+int swapread(char* ptr, int blkno)
+{
+	struct swaparea* sa;
+	int i, off;
+
+	if((sa = swap_locate(blkno, &off)) == 0)
+		return -1;
+
+	for ( i=0; i < BLKS_PER_PG; ++i ) {
+		nr_sectors_read++;
+		bdirect(sa->dev, area_block(sa, off, i), ptr + i * BSIZE, 0);
+	}
+	return 0;
+}
+
+// Write ptr to the page of slot, which must have been given a
+// place by swap_reserve().  Returns -1 if it has none.
+int swapwrite(char* ptr, int blkno)
+{
+	struct swaparea* sa;
+	int i, off;
+
+	if((sa = swap_locate(blkno, &off)) == 0)
+		return -1;
+
+	for ( i=0; i < BLKS_PER_PG; ++i ) {
+		nr_sectors_write++;
+		bdirect(sa->dev, area_block(sa, off, i), ptr + i * BSIZE, 1);
+	}
+	return 0;
+}
+
+//PAGEBREAK!
+// Add the disk of device file ip as a swap area.
+// Caller must hold ip->lock.
+int
+swapon(struct inode *ip, int prio)
+{
+  struct swaparea *sa;
+
+  // The boot disk and the file system disk are never swapped on.
+  if(ip->type != T_DEV || ip->major != DISK || ip->minor == 0 ||
+     ip->minor == ROOTDEV)
+    return -1;
+
+  acquire(&swap.lock);
+  for(sa = swap.area; sa < &swap.area[NSWAPAREA]; sa++){
+    if(sa->used && sa->dev == ip->minor){
+      release(&swap.lock);
+      return -1;
+    }
+  }
+  release(&swap.lock);
+
+  return area_add(ip->minor, 0, idesize(ip->minor) / BLKS_PER_PG, prio);
+}
+
+// Remove the swap area on disk dev, moving its pages to the other
+// areas or the compressed pool.  Returns -1, leaving the area in
+// place, if there is no such area or not enough room elsewhere.
+int
+swapoff(int dev)
+{
+  struct swapslot *ss;
+  struct swaparea *sa;
+  int a, slot, off, stored;
+
+  acquire(&swap.lock);
+  for(sa = swap.area; sa < &swap.area[NSWAPAREA]; sa++)
+    if(sa->used && !sa->draining && sa->dev == dev)
+      break;
+  if(sa == &swap.area[NSWAPAREA]){
+    release(&swap.lock);
+    return -1;
+  }
+  sa->draining = 1;
+  a = sa - swap.area + 1;
+  release(&swap.lock);
+
+  // Holding paging_lock keeps all other swap I/O out while
+  // pages change places.
+  acquiresleep(&paging_lock);
+  for(slot = 1; slot < nswapslots; slot++){
+    ss = slotinfo(slot);
+    if((ss->loc >> 16) != a)
+      continue;
+    off = ss->loc & 0xffff;
+    swapread(swap_bounce, slot);
+
+    // Slots are freed under clock_algorithm_lock; this one may
+    // have been while it was read.
+    acquire(&clock_algorithm_lock);
+    if(ss->refs == 0 || ss->loc != (a << 16 | off)){
+      release(&clock_algorithm_lock);
+      continue;
+    }
+    acquire(&swap.lock);
+    ss->loc = 0;
+    release(&swap.lock);
+    stored = zswap_store(slot, swap_bounce, 0) >= 0;
+    if(!stored && swap_reserve(slot) < 0){
+      acquire(&swap.lock);
+      ss->loc = a << 16 | off;
+      sa->draining = 0;
+      release(&swap.lock);
+      release(&clock_algorithm_lock);
+      releasesleep(&paging_lock);
+      return -1;
+    }
+    acquire(&swap.lock);
+    sa->map[off/8] &= ~(1 << (off%8));
+    sa->nfree++;
+    release(&swap.lock);
+    release(&clock_algorithm_lock);
+    if(!stored)
+      swapwrite(swap_bounce, slot);
+  }
+  releasesleep(&paging_lock);
+
+  acquire(&swap.lock);
+  sa->used = 0;
+  kfree((char*)sa->map);
+  release(&swap.lock);
+  return 0;
+}
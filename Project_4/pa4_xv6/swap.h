@@ -0,0 +1,10 @@
+// State of a swap slot, found by slotinfo().  Each field belongs to
+// the file that keeps it and is protected by that file's lock.
+struct swapslot {
+  uint loc;              // swap.c: (area+1) << 16 | page offset, 0 if none
+  struct page *cache;    // kalloc.c: swap cache frame holding a copy
+  short refs;            // kalloc.c: references, 0 if the slot is free
+  short zpage;           // zswap.c: pool index + 1, 0 if none
+  ushort zlen;           // zswap.c: compressed length of the object
+  uchar zchunk;          // zswap.c: first chunk of the object
+};
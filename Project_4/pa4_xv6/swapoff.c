@@ -0,0 +1,28 @@
+// swapoff: remove swap areas.
+//   swapoff paths...
+// Moves the pages of each area to the other areas or the compressed
+// pool first; stops at the first area that does not fit there.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+int
+main(int argc, char *argv[])
+{
+  int i;
+
+  if(argc < 2){
+    printf(2, "Usage: swapoff paths...\n");
+    exit();
+  }
+
+  for(i = 1; i < argc; i++){
+    if(swapoff(argv[i]) < 0){
+      printf(2, "swapoff: %s failed\n", argv[i]);
+      break;
+    }
+  }
+
+  exit();
+}
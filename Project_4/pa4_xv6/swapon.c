@@ -0,0 +1,29 @@
+// swapon: add a swap area.
+//   swapon [-p priority] path
+// path is a disk device file, such as hdc.  Pages go to the areas
+// of highest priority first (default 0; the boot disk area has -1),
+// striped across areas of equal priority.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+int
+main(int argc, char *argv[])
+{
+  int prio, i;
+
+  prio = 0;
+  i = 1;
+  if(argc > 2 && strcmp(argv[1], "-p") == 0){
+    prio = atoi(argv[2]);
+    i = 3;
+  }
+  if(i != argc - 1){
+    printf(2, "Usage: swapon [-p priority] path\n");
+    exit();
+  }
+  if(swapon(argv[i], prio) < 0)
+    printf(2, "swapon: %s failed\n", argv[i]);
+  exit();
+}
@@ -21,26 +21,24 @@ fetchint(uint addr, int *ip)
 
   if(addr >= curproc->sz || addr+4 > curproc->sz)
     return -1;
-  *ip = *(int*)(addr);
-  return 0;
+  return umove(ip, (void*)addr, sizeof(*ip));
 }
 
-// Fetch the nul-terminated string at addr from the current process.
-// Doesn't actually copy the string - just sets *pp to point at it.
-// Returns length of string, not including nul.
+// Fetch the nul-terminated string at addr from the current process
+// into buf, which holds max bytes.  The kernel works on the copy:
+// the user's page could be swapped out again before it is done.
+// Returns length of string, not including nul, or -1.
 int
-fetchstr(uint addr, char **pp)
+fetchstr(uint addr, char *buf, int max)
 {
-  char *s, *ep;
   struct proc *curproc = myproc();
+  int i;
 
-  if(addr >= curproc->sz)
-    return -1;
-  *pp = (char*)addr;
-  ep = (char*)curproc->sz;
-  for(s = *pp; s < ep; s++){
-    if(*s == 0)
-      return s - *pp;
+  for(i = 0; i < max && addr+i < curproc->sz; i++){
+    if(umove(buf+i, (char*)addr+i, 1) < 0)
+      return -1;
+    if(buf[i] == 0)
+      return i;
   }
   return -1;
 }
@@ -69,17 +67,16 @@ argptr(int n, char **pp, int size)
   return 0;
 }
 
-// Fetch the nth word-sized system call argument as a string pointer.
-// Check that the pointer is valid and the string is nul-terminated.
-// (There is no shared writable memory, so the string can't change
-// between this check and being used by the kernel.)
+// Fetch the nth word-sized system call argument as a string,
+// copied into buf, which holds max bytes.
+// Returns length of string, not including nul, or -1.
 int
-argstr(int n, char **pp)
+argstr(int n, char *buf, int max)
 {
   int addr;
   if(argint(n, &addr) < 0)
     return -1;
-  return fetchstr(addr, pp);
+  return fetchstr(addr, buf, max);
 }
 
 extern int sys_chdir(void);
@@ -106,6 +103,16 @@ extern int sys_uptime(void);
 extern int sys_swapread(void);
 extern int sys_swapwrite(void);
 extern int sys_swapstat(void);
+extern int sys_zswapstat(void);
+extern int sys_swapon(void);
+extern int sys_swapoff(void);
+extern int sys_mlock(void);
+extern int sys_munlock(void);
+extern int sys_mlockall(void);
+extern int sys_munlockall(void);
+extern int sys_vmstat(void);
+extern int sys_ksmscan(void);
+extern int sys_compact(void);
 
 static int (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
@@ -132,6 +139,16 @@ static int (*syscalls[])(void) = {
 [SYS_swapread]	sys_swapread,
 [SYS_swapwrite] sys_swapwrite,
 [SYS_swapstat] sys_swapstat,
+[SYS_zswapstat] sys_zswapstat,
+[SYS_swapon]  sys_swapon,
+[SYS_swapoff] sys_swapoff,
+[SYS_mlock]   sys_mlock,
+[SYS_munlock] sys_munlock,
+[SYS_mlockall] sys_mlockall,
+[SYS_munlockall] sys_munlockall,
+[SYS_vmstat]  sys_vmstat,
+[SYS_ksmscan] sys_ksmscan,
+[SYS_compact] sys_compact,
 };
 
 void
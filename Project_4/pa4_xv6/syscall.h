@@ -23,3 +23,13 @@
 #define SYS_swapread	22
 #define SYS_swapwrite	23
 #define SYS_swapstat	24
+#define SYS_zswapstat	25
+#define SYS_swapon	26
+#define SYS_swapoff	27
+#define SYS_mlock	28
+#define SYS_munlock	29
+#define SYS_mlockall	30
+#define SYS_munlockall	31
+#define SYS_vmstat	32
+#define SYS_ksmscan	33
+#define SYS_compact	34
@@ -15,6 +15,8 @@
 #include "sleeplock.h"
 #include "file.h"
 #include "fcntl.h"
+#include "zswap.h"
+#include "vmstat.h"
 
 // Fetch the nth word-sized system call argument as a file descriptor
 // and return both the descriptor and the corresponding struct file.
@@ -107,21 +109,23 @@ int
 sys_fstat(void)
 {
   struct file *f;
-  struct stat *st;
+  struct stat *st, kst;
 
   if(argfd(0, 0, &f) < 0 || argptr(1, (void*)&st, sizeof(*st)) < 0)
     return -1;
-  return filestat(f, st);
+  if(filestat(f, &kst) < 0)
+    return -1;
+  return umove(st, &kst, sizeof(kst));
 }
 
 // Create the path new as a link to the same inode as old.
 int
 sys_link(void)
 {
-  char name[DIRSIZ], *new, *old;
+  char name[DIRSIZ], new[MAXPATH], old[MAXPATH];
   struct inode *dp, *ip;
 
-  if(argstr(0, &old) < 0 || argstr(1, &new) < 0)
+  if(argstr(0, old, sizeof(old)) < 0 || argstr(1, new, sizeof(new)) < 0)
     return -1;
 
   begin_op();
@@ -186,10 +190,10 @@ sys_unlink(void)
 {
   struct inode *ip, *dp;
   struct dirent de;
-  char name[DIRSIZ], *path;
+  char name[DIRSIZ], path[MAXPATH];
   uint off;
 
-  if(argstr(0, &path) < 0)
+  if(argstr(0, path, sizeof(path)) < 0)
     return -1;
 
   begin_op();
@@ -285,12 +289,12 @@ create(char *path, short type, short major, short minor)
 int
 sys_open(void)
 {
-  char *path;
+  char path[MAXPATH];
   int fd, omode;
   struct file *f;
   struct inode *ip;
 
-  if(argstr(0, &path) < 0 || argint(1, &omode) < 0)
+  if(argstr(0, path, sizeof(path)) < 0 || argint(1, &omode) < 0)
     return -1;
 
   begin_op();
@@ -335,11 +339,11 @@ sys_open(void)
 int
 sys_mkdir(void)
 {
-  char *path;
+  char path[MAXPATH];
   struct inode *ip;
 
   begin_op();
-  if(argstr(0, &path) < 0 || (ip = create(path, T_DIR, 0, 0)) == 0){
+  if(argstr(0, path, sizeof(path)) < 0 || (ip = create(path, T_DIR, 0, 0)) == 0){
     end_op();
     return -1;
   }
@@ -352,11 +356,11 @@ int
 sys_mknod(void)
 {
   struct inode *ip;
-  char *path;
+  char path[MAXPATH];
   int major, minor;
 
   begin_op();
-  if((argstr(0, &path)) < 0 ||
+  if((argstr(0, path, sizeof(path))) < 0 ||
      argint(1, &major) < 0 ||
      argint(2, &minor) < 0 ||
      (ip = create(path, T_DEV, major, minor)) == 0){
@@ -371,12 +375,12 @@ sys_mknod(void)
 int
 sys_chdir(void)
 {
-  char *path;
+  char path[MAXPATH];
   struct inode *ip;
   struct proc *curproc = myproc();
   
   begin_op();
-  if(argstr(0, &path) < 0 || (ip = namei(path)) == 0){
+  if(argstr(0, path, sizeof(path)) < 0 || (ip = namei(path)) == 0){
     end_op();
     return -1;
   }
@@ -396,33 +400,45 @@ sys_chdir(void)
 int
 sys_exec(void)
 {
-  char *path, *argv[MAXARG];
-  int i;
+  char path[MAXPATH], *argv[MAXARG], *args, *s;
+  int i, n, r;
   uint uargv, uarg;
 
-  if(argstr(0, &path) < 0 || argint(1, (int*)&uargv) < 0){
+  if(argstr(0, path, sizeof(path)) < 0 || argint(1, (int*)&uargv) < 0){
     return -1;
   }
+  // The arguments have to fit in the new process's one-page stack,
+  // so a page holds all their copies.
+  if((args = kalloc()) == 0)
+    return -1;
   memset(argv, 0, sizeof(argv));
+  s = args;
+  r = -1;
   for(i=0;; i++){
     if(i >= NELEM(argv))
-      return -1;
+      goto bad;
     if(fetchint(uargv+4*i, (int*)&uarg) < 0)
-      return -1;
+      goto bad;
     if(uarg == 0){
       argv[i] = 0;
       break;
     }
-    if(fetchstr(uarg, &argv[i]) < 0)
-      return -1;
+    if((n = fetchstr(uarg, s, args + PGSIZE - s)) < 0)
+      goto bad;
+    argv[i] = s;
+    s += n + 1;
   }
-  return exec(path, argv);
+  r = exec(path, argv);
+
+bad:
+  kfree(args);
+  return r;
 }
 
 int
 sys_pipe(void)
 {
-  int *fd;
+  int *fd, fds[2];
   struct file *rf, *wf;
   int fd0, fd1;
 
@@ -438,33 +454,52 @@ sys_pipe(void)
     fileclose(wf);
     return -1;
   }
-  fd[0] = fd0;
-  fd[1] = fd1;
+  fds[0] = fd0;
+  fds[1] = fd1;
+  if(umove(fd, fds, sizeof(fds)) < 0){
+    myproc()->ofile[fd0] = 0;
+    myproc()->ofile[fd1] = 0;
+    fileclose(rf);
+    fileclose(wf);
+    return -1;
+  }
   return 0;
 }
 
+// The page goes through a kernel page, not straight to or from the
+// user's buffer, which may itself be swapped out.
 int sys_swapread(void)
 {
 	char* ptr;
-	int blkno;
+	char* page;
+	int blkno, r;
 
 	if(argptr(0, &ptr, PGSIZE) < 0 || argint(1, &blkno) < 0 )
 		return -1;
+	if((page = kalloc()) == 0)
+		return -1;
 
-	swapread(ptr, blkno);
-	return 0;
+	if((r = swapread(page, blkno)) == 0)
+		r = umove(ptr, page, PGSIZE);
+	kfree(page);
+	return r;
 }
 
 int sys_swapwrite(void)
 {
 	char* ptr;
-	int blkno;
+	char* page;
+	int blkno, r;
 
 	if(argptr(0, &ptr, PGSIZE) < 0 || argint(1, &blkno) < 0 )
 		return -1;
+	if((page = kalloc()) == 0)
+		return -1;
 
-	swapwrite(ptr, blkno);
-	return 0;
+	if((r = umove(page, ptr, PGSIZE)) == 0)
+		r = swapwrite(page, blkno);
+	kfree(page);
+	return r;
 }
 
 int sys_swapstat(void)
@@ -476,7 +511,82 @@ int sys_swapstat(void)
 			argptr(1, (void*)&nr_write, sizeof(*nr_write)) < 0)
 		return -1;
 
-	*nr_read = nr_sectors_read;
-	*nr_write = nr_sectors_write;
+	if(umove(nr_read, &nr_sectors_read, sizeof(*nr_read)) < 0 ||
+			umove(nr_write, &nr_sectors_write, sizeof(*nr_write)) < 0)
+		return -1;
 	return 0;
 }
+
+// The counters are gathered under spinlocks, so they are copied
+// out to the user's buffer only after.
+int sys_zswapstat(void)
+{
+	struct zswapstat* st;
+	struct zswapstat kst;
+
+	if(argptr(0, (void*)&st, sizeof(*st)) < 0)
+		return -1;
+
+	zswap_getstat(&kst);
+	return umove(st, &kst, sizeof(kst));
+}
+
+int sys_vmstat(void)
+{
+	struct vmstat* st;
+	struct vmstat kst;
+
+	if(argptr(0, (void*)&st, sizeof(*st)) < 0)
+		return -1;
+
+	vm_getstat(&kst);
+	return umove(st, &kst, sizeof(kst));
+}
+
+int
+sys_swapon(void)
+{
+  char path[MAXPATH];
+  int prio, r;
+  struct inode *ip;
+
+  if(argstr(0, path, sizeof(path)) < 0 || argint(1, &prio) < 0)
+    return -1;
+  begin_op();
+  if((ip = namei(path)) == 0){
+    end_op();
+    return -1;
+  }
+  ilock(ip);
+  r = swapon(ip, prio);
+  iunlockput(ip);
+  end_op();
+  return r;
+}
+
+int
+sys_swapoff(void)
+{
+  char path[MAXPATH];
+  int dev;
+  struct inode *ip;
+
+  if(argstr(0, path, sizeof(path)) < 0)
+    return -1;
+  begin_op();
+  if((ip = namei(path)) == 0){
+    end_op();
+    return -1;
+  }
+  ilock(ip);
+  dev = -1;
+  if(ip->type == T_DEV && ip->major == DISK)
+    dev = ip->minor;
+  iunlockput(ip);
+  end_op();
+  if(dev < 0)
+    return -1;
+
+  // Moving pages out can take a while; hold no locks meanwhile.
+  return swapoff(dev);
+}
@@ -89,3 +89,82 @@ sys_uptime(void)
   release(&tickslock);
   return xticks;
 }
+
+// Check that [addr, addr+len) lies in the process's memory and
+// return its page-aligned bounds.
+static int
+argrange(int n, uint *start, uint *end)
+{
+  int addr, len;
+  struct proc *curproc = myproc();
+
+  if(argint(n, &addr) < 0 || argint(n+1, &len) < 0)
+    return -1;
+  if(len < 0 || (uint)addr >= curproc->sz || (uint)addr+len > curproc->sz)
+    return -1;
+  *start = PGROUNDDOWN((uint)addr);
+  *end = PGROUNDUP((uint)addr+len);
+  return 0;
+}
+
+int
+sys_mlock(void)
+{
+  uint start, end;
+
+  if(argrange(0, &start, &end) < 0)
+    return -1;
+  return mlock_range(myproc()->pgdir, start, end, 1);
+}
+
+int
+sys_munlock(void)
+{
+  uint start, end;
+
+  if(argrange(0, &start, &end) < 0)
+    return -1;
+  return mlock_range(myproc()->pgdir, start, end, 0);
+}
+
+int
+sys_mlockall(void)
+{
+  int flags;
+  struct proc *curproc = myproc();
+
+  if(argint(0, &flags) < 0 || flags == 0 ||
+     (flags & ~(MCL_CURRENT | MCL_FUTURE)))
+    return -1;
+  if((flags & MCL_CURRENT) &&
+     mlock_range(curproc->pgdir, 0, curproc->sz, 1) < 0)
+    return -1;
+  if(flags & MCL_FUTURE)
+    mlock_future(curproc->pgdir, 1);
+  return 0;
+}
+
+int
+sys_munlockall(void)
+{
+  struct proc *curproc = myproc();
+
+  mlock_future(curproc->pgdir, 0);
+  return mlock_range(curproc->pgdir, 0, curproc->sz, 0);
+}
+
+int
+sys_ksmscan(void)
+{
+  int n;
+
+  if(argint(0, &n) < 0 || n <= 0)
+    return -1;
+  return ksm_scan(n);
+}
+
+int
+sys_compact(void)
+{
+  return compact();
+}
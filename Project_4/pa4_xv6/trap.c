@@ -11,6 +11,7 @@
 // Interrupt descriptor table (shared by all CPUs).
 struct gatedesc idt[256];
 extern uint vectors[];  // in vectors.S: array of 256 entry pointers
+extern char umove_end[], umove_fault[];  // in umove.S
 struct spinlock tickslock;
 uint ticks;
 
@@ -43,6 +44,8 @@ trap(struct trapframe *tf)
     syscall();
     if(myproc()->killed)
       exit();
+    if(myproc()->swapstate == PS_SWAPPED)
+      swapin_all();
     return;
   }
 
@@ -57,21 +60,13 @@ trap(struct trapframe *tf)
     lapiceoi();
     break;
   case T_IRQ0 + IRQ_IDE:
-    ideintr();
+    ideintr(0);
     lapiceoi();
     break;
   case T_IRQ0 + IRQ_IDE+1:
-    // Bochs generates spurious IDE1 interrupts.
-    break;
-  case T_PGFLT:
-    if (tf->trapno!=14){
-      cprintf("Something wrong");
-    }
-    //cprintf("T_PGFLT");
-    struct proc* curproc = myproc();
-    page_fault_handle(
-      tf->trapno, PGROUNDDOWN(rcr2()), curproc->pgdir
-    );
+    // Secondary channel; Bochs also raises spurious ones here.
+    ideintr(1);
+    lapiceoi();
     break;
   case T_IRQ0 + IRQ_KBD:
     kbdintr();
@@ -88,6 +83,21 @@ trap(struct trapframe *tf)
     lapiceoi();
     break;
 
+  case T_PGFLT:
+    // Swap the page back in; any other fault is handled as below.
+    // Doing so may sleep, which the kernel cannot do while it holds
+    // a spinlock, so such a fault is not handled.
+    if(myproc() && mycpu()->ncli == 0 &&
+       page_fault_handle(tf->trapno, PGROUNDDOWN(rcr2()),
+                         myproc()->pgdir) == 0)
+      break;
+    // A copy to or from user memory in umove() fails instead.
+    if((tf->cs&3) == 0 &&
+       tf->eip >= (uint)umove && tf->eip < (uint)umove_end){
+      tf->eip = (uint)umove_fault;
+      break;
+    }
+    // fall through
   //PAGEBREAK: 13
   default:
     if(myproc() == 0 || (tf->cs&3) == 0){
@@ -119,4 +129,7 @@ trap(struct trapframe *tf)
   // Check if the process has been killed since we yielded
   if(myproc() && myproc()->killed && (tf->cs&3) == DPL_USER)
     exit();
+
+  if(myproc() && myproc()->swapstate == PS_SWAPPED && (tf->cs&3) == DPL_USER)
+    swapin_all();
 }
@@ -1,5 +1,7 @@
 struct stat;
 struct rtcdate;
+struct zswapstat;
+struct vmstat;
 
 // system calls
 int fork(void);
@@ -23,9 +25,19 @@ int getpid(void);
 char* sbrk(int);
 int sleep(int);
 int uptime(void);
-void swapread(const char*, int);
-void swapwrite(const char*, int);
+int swapread(const char*, int);
+int swapwrite(const char*, int);
 void swapstat(int*, int*);
+int zswapstat(struct zswapstat*);
+int swapon(const char*, int);
+int swapoff(const char*);
+int mlock(const void*, int);
+int munlock(const void*, int);
+int mlockall(int);
+int munlockall(void);
+int vmstat(struct vmstat*);
+int ksmscan(int);
+int compact(void);
 
 // ulib.c
 int stat(const char*, struct stat*);
@@ -7,6 +7,7 @@
 #include "syscall.h"
 #include "traps.h"
 #include "memlayout.h"
+#include "vmstat.h"
 
 char buf[8192];
 char name[3];
@@ -1745,6 +1746,94 @@ rand()
   return randstate;
 }
 
+// Fill n pages at sbrk(0) with random words, which zswap cannot
+// compress, so that the ones evicted go to a swap area.
+// Returns the start of the pages.
+uint*
+swapfill(int n, uint seed)
+{
+  uint *p;
+  int i;
+
+  if((p = (uint*)sbrk(n * 4096)) == (uint*)-1){
+    printf(stdout, "swap test: sbrk %d pages failed\n", n);
+    exit();
+  }
+  randstate = seed;
+  for(i = 0; i < n * 1024; i++)
+    p[i] = rand();
+  return p;
+}
+
+// swapon and swapoff of the swap disk hdc, with pages on it.
+void
+swaptest(void)
+{
+  struct vmstat st;
+  uint *p;
+  int was, bootfree, pid, n, i;
+
+  printf(stdout, "swap test\n");
+  was = swapoff("hdc") == 0;
+  if(swapon("hdc", 10) < 0){
+    printf(stdout, "swapon hdc failed\n");
+    exit();
+  }
+  if(swapon("hdc", 10) >= 0){
+    printf(stdout, "swapon hdc twice succeeded\n");
+    exit();
+  }
+
+  // Swap out some pages, to hdc first, then move them to the boot
+  // disk area, which has room for them.
+  pid = fork();
+  if(pid == 0){
+    vmstat(&st);
+    n = st.free_pages + st.file_pages + 256;
+    p = swapfill(n, 1);
+    if(swapoff("hdc") < 0){
+      printf(stdout, "swapoff with pages out failed\n");
+      exit();
+    }
+    randstate = 1;
+    for(i = 0; i < n * 1024; i++){
+      if(p[i] != rand()){
+        printf(stdout, "swap test: page %d lost by swapoff\n", i / 1024);
+        exit();
+      }
+    }
+    exit();
+  }
+  wait();
+  vmstat(&st);
+  bootfree = st.swap_free;
+  if(swapon("hdc", 10) < 0){
+    printf(stdout, "swapon hdc after swapoff failed\n");
+    exit();
+  }
+
+  // Swap out more than the boot disk area has room for; swapoff
+  // must refuse and leave hdc on.
+  pid = fork();
+  if(pid == 0){
+    vmstat(&st);
+    swapfill(st.free_pages + st.file_pages + bootfree + 512, 2);
+    if(swapoff("hdc") == 0){
+      printf(stdout, "swapoff with no room left succeeded\n");
+      exit();
+    }
+    exit();
+  }
+  wait();
+  if(swapoff("hdc") < 0){
+    printf(stdout, "swapoff hdc failed\n");
+    exit();
+  }
+  if(was)
+    swapon("hdc", 0);
+  printf(stdout, "swap test OK\n");
+}
+
 int
 main(int argc, char *argv[])
 {
@@ -1780,6 +1869,7 @@ main(int argc, char *argv[])
   iputtest();
 
   mem();
+  swaptest();
   pipe1();
   preempt();
   exitwait();
@@ -6,6 +6,7 @@
 #include "mmu.h"
 #include "proc.h"
 #include "elf.h"
+#include "traps.h"
 
 extern char data[];  // defined by kernel.ld
 pde_t *kpgdir;  // for use in scheduler()
@@ -124,6 +125,7 @@ setupkvm(void)
   if((pgdir = (pde_t*)kalloc()) == 0)
     return 0;
   memset(pgdir, 0, PGSIZE);
+  pgdir_init(pgdir);
   if (P2V(PHYSTOP) > (void*)DEVSPACE)
     panic("PHYSTOP too high");
   for(k = kmap; k < &kmap[NELEM(kmap)]; k++)
@@ -208,6 +210,10 @@ loaduvm(pde_t *pgdir, char *addr, struct inode *ip, uint offset, uint sz)
   for(i = 0; i < sz; i += PGSIZE){
     if((pte = walkpgdir(pgdir, addr+i, 0)) == 0)
       panic("loaduvm: address should exist");
+    if((!(*pte & PTE_P) || (*pte & PTE_KSM)) &&
+       page_fault_handle(T_PGFLT, (uint)addr+i, pgdir) < 0)
+      return -1;
+    *pte |= PTE_D;  // written through the kernel mapping below
     pa = PTE_ADDR(*pte);
     if(sz - i < PGSIZE)
       n = sz - i;
@@ -263,7 +269,7 @@ int
 deallocuvm(pde_t *pgdir, uint oldsz, uint newsz)
 {
   pte_t *pte;
-  uint a, pa;
+  uint a;
 
   if(newsz >= oldsz)
     return oldsz;
@@ -273,16 +279,8 @@ deallocuvm(pde_t *pgdir, uint oldsz, uint newsz)
     pte = walkpgdir(pgdir, (char*)a, 0);
     if(!pte)
       a = PGADDR(PDX(a) + 1, 0, 0) - PGSIZE;
-    else if((*pte & PTE_P) != 0){
-      pa = PTE_ADDR(*pte);
-      if(pa == 0)
-        panic("kfree");
-      if(page_list_remove((char*)a, 0, pgdir)=='n'){
-        char *v = P2V(pa);
-        kfree(v);
-        *pte = 0;
-      }
-    }
+    else if((*pte & (PTE_P | PTE_SWAP)) != 0)
+      page_list_remove((char*)a, 0, pgdir);
   }
   return newsz;
 }
@@ -324,7 +322,6 @@ clearpteu(pde_t *pgdir, char *uva)
 pde_t*
 copyuvm(pde_t *pgdir, uint sz)
 {
-  char insertion_condition = 0;
   pde_t *d;
   pte_t *pte;
   uint pa, i, flags;
@@ -335,36 +332,37 @@ copyuvm(pde_t *pgdir, uint sz)
   for(i = 0; i < sz; i += PGSIZE){
     if((pte = walkpgdir(pgdir, (void *) i, 0)) == 0)
       panic("copyuvm: pte should exist");
+    if(*pte & PTE_SWAP){
+      if(swap_send(pgdir, 0, d, i) < 0)
+        goto bad;
+      continue;
+    }
     if(!(*pte & PTE_P))
-    {
-        if(!(*pte & 0x100)){
-          panic("copyuvm: page not present");
-        }
-        else{
-          swap_send(pgdir, 0, d, i);
-        }
+      panic("copyuvm: page not present");
+    if(*pte & PTE_KSM){
+      // Merged by KSM; the child shares it too.
+      if(mappages(d, (void*)i, PGSIZE, PTE_ADDR(*pte), PTE_FLAGS(*pte)) < 0)
+        goto bad;
+      ksm_dup(d, PTE_ADDR(*pte));
+      continue;
     }
-    else
-    {
-        pa = PTE_ADDR(*pte);
-        flags = PTE_FLAGS(*pte);
-        if((mem = kalloc()) == 0)
-          goto bad;
-        memmove(mem, (char*)P2V(pa), PGSIZE);
-        if(mappages(d, (void*)i, PGSIZE, V2P(mem), flags) < 0) {
-          kfree(mem);
-          goto bad;
-        }
+    if((mem = kalloc()) == 0)
+      goto bad;
+    if(!(*pte & PTE_P) || (*pte & PTE_KSM)){
+      // kalloc() swapped or merged this very page; go again.
+      kfree(mem);
+      i -= PGSIZE;
+      continue;
     }
-    
-    if((*pte&0b101) == 0b101){
-      insertion_condition = 1;
-      
+    pa = PTE_ADDR(*pte);
+    flags = PTE_FLAGS(*pte);
+    memmove(mem, (char*)P2V(pa), PGSIZE);
+    if(mappages(d, (void*)i, PGSIZE, V2P(mem), flags) < 0) {
+      kfree(mem);
+      goto bad;
     }
-
-    if(insertion_condition){
+    if((flags & PTE_U) != 0)
       pagelist_insertion((char*) i, 0, d);
-    }
   }
   return d;
 
@@ -381,10 +379,15 @@ uva2ka(pde_t *pgdir, char *uva)
   pte_t *pte;
 
   pte = walkpgdir(pgdir, uva, 0);
+  if((*pte & (PTE_SWAP | PTE_KSM)) != 0)
+    page_fault_handle(T_PGFLT, (uint)uva, pgdir);
   if((*pte & PTE_P) == 0)
     return 0;
   if((*pte & PTE_U) == 0)
     return 0;
+  // Callers write through the kernel mapping, which the MMU
+  // does not track in this PTE.
+  *pte |= PTE_D;
   return (char*)P2V(PTE_ADDR(*pte));
 }
 
@@ -0,0 +1,134 @@
+// vmstat: report paging statistics.
+//   vmstat              totals since boot and fault latencies
+//   vmstat secs [count] a line every secs seconds; the event
+//                       columns count what happened since the last
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "vmstat.h"
+
+// Print n right-aligned in a column w wide.
+static void
+col(int n, int w)
+{
+  int d, m;
+
+  for(d = 1, m = n; m >= 10 || m <= -10; m /= 10)
+    d++;
+  if(n < 0)
+    d++;
+  while(w-- > d)
+    printf(1, " ");
+  printf(1, " %d", n);
+}
+
+static void
+report(struct vmstat *v)
+{
+  int i;
+
+  printf(1, "%d free pages\n", v->free_pages);
+  printf(1, "%d active pages\n", v->active_pages);
+  printf(1, "%d inactive pages\n", v->inactive_pages);
+  printf(1, "%d locked pages\n", v->locked_pages);
+  printf(1, "%d swap cache pages\n", v->swapcache_pages);
+  printf(1, "%d buffer cache pages\n", v->file_pages);
+  printf(1, "%d swap slots in use\n", v->swap_slots);
+  printf(1, "%d of %d swap disk pages free\n", v->swap_free, v->swap_total);
+  printf(1, "%d minor faults\n", v->minor_faults);
+  printf(1, "%d major faults\n", v->major_faults);
+  printf(1, "%d pages swapped in\n", v->swapins);
+  printf(1, "%d pages swapped out\n", v->swapouts);
+  printf(1, "%d pages scanned\n", v->pages_scanned);
+  printf(1, "%d reclaim runs\n", v->reclaims);
+  printf(1, "%d allocation stalls\n", v->stalls);
+  printf(1, "%d buffer cache pages dropped\n", v->file_drops);
+  printf(1, "%d buffer cache refaults\n", v->file_refaults);
+  printf(1, "%d idle processes swapped out, %d pages\n",
+         v->idle_swapouts, v->idle_pages);
+  printf(1, "%d KSM pages shared %d times, saving %d pages\n",
+         v->ksm_pages, v->ksm_sharing, v->ksm_sharing - v->ksm_pages);
+  printf(1, "%d KSM merges, %d broken by writes\n",
+         v->ksm_merges, v->ksm_unmerges);
+  printf(1, "%d compaction runs moved %d pages\n",
+         v->compact_runs, v->compact_moved);
+  printf(1, "free blocks by order:");
+  for(i = 0; i < NFREEORDER; i++)
+    printf(1, " %d", v->free_blocks[i]);
+  printf(1, "\n");
+
+  printf(1, "page fault latency, cycles:\n");
+  for(i = 0; i < NFAULTHIST; i++){
+    if(v->fault_hist[i] == 0)
+      continue;
+    if(i < NFAULTHIST - 1)
+      printf(1, "  < 2^%d", FAULTHIST_LO + i);
+    else
+      printf(1, " >= 2^%d", FAULTHIST_LO + i - 1);
+    col(v->fault_hist[i], 9);
+    printf(1, "\n");
+  }
+}
+
+static void
+header(void)
+{
+  printf(1, "  free   act inact  lock  swpd    si    so   min   maj"
+            "  scan  recl stall\n");
+}
+
+static void
+line(struct vmstat *v, struct vmstat *o)
+{
+  col(v->free_pages, 5);
+  col(v->active_pages, 5);
+  col(v->inactive_pages, 5);
+  col(v->locked_pages, 5);
+  col(v->swap_slots, 5);
+  col(v->swapins - o->swapins, 5);
+  col(v->swapouts - o->swapouts, 5);
+  col(v->minor_faults - o->minor_faults, 5);
+  col(v->major_faults - o->major_faults, 5);
+  col(v->pages_scanned - o->pages_scanned, 5);
+  col(v->reclaims - o->reclaims, 5);
+  col(v->stalls - o->stalls, 5);
+  printf(1, "\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct vmstat v, o;
+  int secs, count, i;
+
+  secs = argc > 1 ? atoi(argv[1]) : 0;
+  if(argc > 3 || (argc > 1 && secs <= 0)){
+    printf(2, "Usage: vmstat [secs [count]]\n");
+    exit();
+  }
+  if(argc == 1){
+    if(vmstat(&v) < 0){
+      printf(2, "vmstat: failed\n");
+      exit();
+    }
+    report(&v);
+    exit();
+  }
+
+  count = argc > 2 ? atoi(argv[2]) : 0;
+  memset(&o, 0, sizeof(o));
+  for(i = 0; count == 0 || i < count; i++){
+    if(i % 20 == 0)
+      header();
+    if(vmstat(&v) < 0){
+      printf(2, "vmstat: failed\n");
+      exit();
+    }
+    line(&v, &o);
+    o = v;
+    if(count == 0 || i + 1 < count)
+      sleep(secs * 100);
+  }
+  exit();
+}
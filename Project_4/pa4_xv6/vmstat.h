@@ -0,0 +1,42 @@
+// Paging statistics, returned by vmstat().
+#define NFAULTHIST   16  // Buckets in the fault latency histogram
+#define FAULTHIST_LO 11  // Bucket 0 holds faults under 2^11 cycles
+#define NFREEORDER   11  // Free blocks of 2^0 up to 2^10 pages
+
+struct vmstat {
+  uint minor_faults;     // Faults served without disk I/O: swap-ins
+                         // from the swap cache or zswap, KSM copies
+  uint major_faults;     // Swap-ins that waited for the disk
+  uint swapins;          // Pages read from swap disk, readahead included
+  uint swapouts;         // Pages written to swap disk
+  uint pages_scanned;    // LRU pages looked at by the clock
+  uint reclaims;         // Runs of the page reclaimer
+  uint stalls;           // Allocations that had to wait for reclaim
+  uint file_drops;       // Buffer cache pages given back by reclaim
+  uint file_refaults;    // Reads of blocks the cache dropped lately
+  uint idle_swapouts;    // Idle processes swapped out whole
+  uint idle_pages;       // Pages they took with them
+  uint ksm_merges;       // Pages freed by merging them with a KSM page
+  uint ksm_unmerges;     // Writes to KSM pages that broke the sharing
+  uint compact_runs;     // Passes of memory compaction
+  uint compact_moved;    // Pages they moved
+  int free_pages;
+  int active_pages;
+  int inactive_pages;
+  int locked_pages;
+  int swapcache_pages;   // Readahead pages not mapped yet
+  int file_pages;        // Pages of the buffer cache
+  int swap_slots;        // Swap slots in use, on disk or in zswap
+  int swap_total;        // Pages of swap disk space
+  int swap_free;
+  int ksm_pages;         // Frames shared by KSM
+  int ksm_sharing;       // Mappings of them; less ksm_pages is saved
+  // Page fault latency in rdtsc cycles, minor and major faults
+  // alike (see page_fault_handle()): bucket i counts faults that
+  // took under 2^(FAULTHIST_LO+i) cycles and not less than half that.
+  // The last bucket also takes everything slower.
+  uint fault_hist[NFAULTHIST];
+  // Free memory as aligned blocks of 2^order pages, each run of
+  // free pages counted as the largest blocks it holds.
+  int free_blocks[NFREEORDER];
+};
@@ -0,0 +1,416 @@
+// Compressed swap pool.
+//
+// swap_out() offers every page it evicts to the pool before writing
+// it to the swap area.  Pages are compressed with a small LZ77 coder
+// (an LZ4-style token stream) and packed into pool pages in 64-byte
+// chunks, keyed by swap slot.  A page goes to disk only if it does
+// not shrink to ZSWAP_MAXOBJ bytes or the pool cannot take it.
+//
+// The pool does not allocate memory while the system is reclaiming.
+// Instead it grows by adopting the frame of the page being evicted
+// once its contents have been compressed, and gives a pool page back
+// to kfree() as soon as its last object is gone.  Once it has
+// ZSWAP_MAXPAGES pages, it makes room by writing the objects of the
+// pool page stored into longest ago out to disk, as zbud does.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "zswap.h"
+#include "swap.h"
+
+#define ZSWAP_CHUNK     64                      // allocation unit
+#define ZSWAP_NCHUNKS   (PGSIZE / ZSWAP_CHUNK)
+#define ZSWAP_MAXOBJ    (PGSIZE * 3 / 4)        // larger is not worth it
+#define ZSWAP_MAXPAGES  2048                    // pool limit (8MB)
+#define ZSWAP_HASHBITS  12
+
+struct zpage {
+  char *mem;             // 0 if this pool entry is unused
+  uint map[2];           // one bit per chunk in use
+  int nfree;             // free chunks
+  uint stamp;            // when an object was last stored here
+};
+
+struct {
+  struct spinlock lock;
+  struct zpage pool[ZSWAP_MAXPAGES];
+  ushort hash[1 << ZSWAP_HASHBITS];
+  uchar buf[ZSWAP_MAXOBJ];
+  char wbbuf[PGSIZE];         // a page being written back
+  uint clock;                 // stores so far, for zpage stamps
+  struct zswapstat stat;
+} zswap;
+
+extern int nswapslots;
+
+void
+zswapinit(void)
+{
+  initlock(&zswap.lock, "zswap");
+}
+
+//PAGEBREAK!
+// LZ coder.  A compressed page is a series of sequences:
+//
+//   token  literals  offset(2)  [extra match length]
+//
+// The token's high nibble is the literal count and its low nibble
+// the match length minus 4; a nibble of 15 is followed by extra
+// length bytes, each 255 except the last.  Decoding ends once PGSIZE
+// bytes are produced, so the final sequence can omit its match.
+
+static int
+lz_putlen(uchar **op, uchar *oend, uint n)
+{
+  for(; n >= 255; n -= 255){
+    if(*op >= oend)
+      return -1;
+    *(*op)++ = 255;
+  }
+  if(*op >= oend)
+    return -1;
+  *(*op)++ = n;
+  return 0;
+}
+
+// Emit one sequence; mlen == 0 means literals only.
+static int
+lz_emit(uchar **op, uchar *oend, uchar *lit, uint nlit, uint off, uint mlen)
+{
+  uint lnib, mnib;
+
+  lnib = nlit < 15 ? nlit : 15;
+  mnib = mlen == 0 ? 0 : (mlen - 4 < 15 ? mlen - 4 : 15);
+  if(*op >= oend)
+    return -1;
+  *(*op)++ = (lnib << 4) | mnib;
+  if(lnib == 15 && lz_putlen(op, oend, nlit - 15) < 0)
+    return -1;
+  if(*op + nlit > oend)
+    return -1;
+  memmove(*op, lit, nlit);
+  *op += nlit;
+  if(mlen == 0)
+    return 0;
+  if(*op + 2 > oend)
+    return -1;
+  *(*op)++ = off & 0xff;
+  *(*op)++ = off >> 8;
+  if(mnib == 15 && lz_putlen(op, oend, mlen - 4 - 15) < 0)
+    return -1;
+  return 0;
+}
+
+// Compress one page from src into dst.  Returns the compressed
+// length, or 0 if it would not fit in max bytes.
+static int
+lz_compress(uchar *src, uchar *dst, int max)
+{
+  uchar *ip, *anchor, *ref, *m, *end, *op, *oend;
+  uint seq, h;
+
+  memset(zswap.hash, 0, sizeof(zswap.hash));
+  ip = anchor = src;
+  end = src + PGSIZE;
+  op = dst;
+  oend = dst + max;
+  while(ip + 4 <= end){
+    seq = *(uint*)ip;
+    h = (seq * 2654435761U) >> (32 - ZSWAP_HASHBITS);
+    ref = src + zswap.hash[h];
+    zswap.hash[h] = ip - src;
+    if(ref >= ip || *(uint*)ref != seq){
+      ip++;
+      continue;
+    }
+    for(m = ip + 4; m < end && *m == ref[m - ip]; m++)
+      ;
+    if(lz_emit(&op, oend, anchor, ip - anchor, ip - ref, m - ip) < 0)
+      return 0;
+    ip = anchor = m;
+  }
+  if(lz_emit(&op, oend, anchor, end - anchor, 0, 0) < 0)
+    return 0;
+  return op - dst;
+}
+
+static int
+lz_getlen(uchar **ip, uchar *iend, uint *n)
+{
+  uint c;
+
+  do {
+    if(*ip >= iend)
+      return -1;
+    c = *(*ip)++;
+    *n += c;
+  } while(c == 255);
+  return 0;
+}
+
+// Decompress len bytes at src into the page dst.
+// Returns 0 on success, -1 if the data is corrupt.
+static int
+lz_decompress(uchar *src, int len, uchar *dst)
+{
+  uchar *ip, *iend, *op, *oend, *ref;
+  uint token, nlit, mlen, off;
+
+  ip = src;
+  iend = src + len;
+  op = dst;
+  oend = dst + PGSIZE;
+  while(op < oend){
+    if(ip >= iend)
+      return -1;
+    token = *ip++;
+    nlit = token >> 4;
+    if(nlit == 15 && lz_getlen(&ip, iend, &nlit) < 0)
+      return -1;
+    if(ip + nlit > iend || op + nlit > oend)
+      return -1;
+    memmove(op, ip, nlit);
+    ip += nlit;
+    op += nlit;
+    if(op == oend)
+      break;
+    if(ip + 2 > iend)
+      return -1;
+    off = ip[0] | (ip[1] << 8);
+    ip += 2;
+    mlen = (token & 15) + 4;
+    if((token & 15) == 15 && lz_getlen(&ip, iend, &mlen) < 0)
+      return -1;
+    if(off == 0 || off > op - dst || op + mlen > oend)
+      return -1;
+    // Byte by byte: the match may overlap its own output.
+    for(ref = op - off; mlen > 0; mlen--)
+      *op++ = *ref++;
+  }
+  return 0;
+}
+
+//PAGEBREAK!
+// Chunk allocator.  Caller must hold zswap.lock.
+
+static int
+chunk_used(struct zpage *zp, int c)
+{
+  return (zp->map[c / 32] >> (c % 32)) & 1;
+}
+
+static void
+chunk_mark(struct zpage *zp, int first, int n, int used)
+{
+  int c;
+
+  for(c = first; c < first + n; c++){
+    if(used)
+      zp->map[c / 32] |= 1 << (c % 32);
+    else
+      zp->map[c / 32] &= ~(1 << (c % 32));
+  }
+  zp->nfree += used ? -n : n;
+}
+
+// Find n free chunks in a row in zp.  Returns the first, or -1.
+static int
+chunk_find(struct zpage *zp, int n)
+{
+  int c, run;
+
+  run = 0;
+  for(c = 0; c < ZSWAP_NCHUNKS; c++){
+    run = chunk_used(zp, c) ? 0 : run + 1;
+    if(run == n)
+      return c - n + 1;
+  }
+  return -1;
+}
+
+// Drop the object of slot.  Its pool page is freed once empty,
+// unless keep is set.
+static void
+zswap_drop(int slot, int keep)
+{
+  struct swapslot *ss;
+  struct zpage *zp;
+  int n;
+
+  ss = slotinfo(slot);
+  zp = &zswap.pool[ss->zpage - 1];
+  n = (ss->zlen + ZSWAP_CHUNK - 1) / ZSWAP_CHUNK;
+  chunk_mark(zp, ss->zchunk, n, 0);
+  zswap.stat.stored_pages--;
+  zswap.stat.compressed_bytes -= ss->zlen;
+  ss->zpage = 0;
+  if(zp->nfree == ZSWAP_NCHUNKS && !keep){
+    kfree(zp->mem);
+    zp->mem = 0;
+    zswap.stat.pool_pages--;
+  }
+}
+
+// Write the objects of the pool page stored into longest ago out to
+// their swap slots on disk, and keep the page, now empty, for the
+// next store.  Releases zswap.lock while writing.  Only
+// zswap_store() calls it, for swap_out(), which holds paging_lock,
+// so that no other store or load comes in meanwhile; a slot may
+// still be freed.  Returns the number of objects written.
+static int
+zswap_writeback(void)
+{
+  struct swapslot *ss;
+  struct zpage *zp, *old;
+  int slot, idx, n;
+
+  old = 0;
+  for(zp = zswap.pool; zp < &zswap.pool[ZSWAP_MAXPAGES]; zp++)
+    if(zp->mem && (old == 0 || zswap.clock - zp->stamp > zswap.clock - old->stamp))
+      old = zp;
+  if(old == 0)
+    return 0;
+  idx = old - zswap.pool + 1;
+  n = 0;
+  for(slot = 1; slot < nswapslots; slot++){
+    ss = slotinfo(slot);
+    if(ss->zpage != idx)
+      continue;
+    if(lz_decompress((uchar*)old->mem + ss->zchunk * ZSWAP_CHUNK,
+                     ss->zlen, (uchar*)zswap.wbbuf) < 0)
+      panic("zswap_writeback: corrupt page");
+    release(&zswap.lock);
+    if(swap_reserve(slot) < 0){  // the disk is full too
+      acquire(&zswap.lock);
+      break;
+    }
+    swapwrite(zswap.wbbuf, slot);
+    acquire(&zswap.lock);
+    if(ss->zpage == idx)  // else freed meanwhile
+      zswap_drop(slot, 1);
+    n++;
+  }
+  zswap.stat.writebacks += n;
+  return n;
+}
+
+//PAGEBREAK!
+// Store the page src under swap slot.  If the pool has no room
+// for it, the pool may take spare (which may be src itself) as a
+// new pool page, or, if it is full, write older objects back to
+// disk.  Only swap_out() gives a spare, holding paging_lock and no
+// spinlock.  Returns 1 if spare was taken, 0 if the page was
+// stored otherwise, and -1 if the page must go to disk.
+int
+zswap_store(int slot, char *src, char *spare)
+{
+  struct swapslot *ss;
+  struct zpage *zp, *empty;
+  int len, n, c, took, tries;
+
+  ss = slotinfo(slot);
+  acquire(&zswap.lock);
+  if(ss->zpage)
+    zswap_drop(slot, 0);
+  if((len = lz_compress((uchar*)src, zswap.buf, ZSWAP_MAXOBJ)) == 0){
+    zswap.stat.rejects++;
+    release(&zswap.lock);
+    return -1;
+  }
+  n = (len + ZSWAP_CHUNK - 1) / ZSWAP_CHUNK;
+
+  for(tries = 0;; tries++){
+    took = 0;
+    c = -1;
+    empty = 0;
+    for(zp = zswap.pool; zp < &zswap.pool[ZSWAP_MAXPAGES]; zp++){
+      if(zp->mem == 0){
+        if(empty == 0)
+          empty = zp;
+        continue;
+      }
+      if(zp->nfree >= n && (c = chunk_find(zp, n)) >= 0)
+        break;
+    }
+    if(c >= 0)
+      break;
+    if(spare && empty){
+      zp = empty;
+      zp->mem = spare;
+      zp->map[0] = zp->map[1] = 0;
+      zp->nfree = ZSWAP_NCHUNKS;
+      zswap.stat.pool_pages++;
+      c = 0;
+      took = 1;
+      break;
+    }
+    if(spare == 0 || tries > 0 || zswap_writeback() == 0){
+      zswap.stat.pool_full++;
+      release(&zswap.lock);
+      return -1;
+    }
+  }
+
+  chunk_mark(zp, c, n, 1);
+  memmove(zp->mem + c * ZSWAP_CHUNK, zswap.buf, len);
+  zp->stamp = ++zswap.clock;
+  ss->zpage = zp - zswap.pool + 1;
+  ss->zchunk = c;
+  ss->zlen = len;
+  zswap.stat.stores++;
+  zswap.stat.stored_pages++;
+  zswap.stat.compressed_bytes += len;
+  release(&zswap.lock);
+  return took;
+}
+
+// Decompress the page of swap slot into dst.
+// Returns 0 on success, -1 if the pool does not hold the slot.
+int
+zswap_load(int slot, char *dst)
+{
+  struct swapslot *ss;
+  struct zpage *zp;
+
+  ss = slotinfo(slot);
+  acquire(&zswap.lock);
+  if(ss->zpage == 0){
+    release(&zswap.lock);
+    return -1;
+  }
+  zp = &zswap.pool[ss->zpage - 1];
+  if(lz_decompress((uchar*)zp->mem + ss->zchunk * ZSWAP_CHUNK,
+                   ss->zlen, (uchar*)dst) < 0)
+    panic("zswap_load: corrupt page");
+  zswap.stat.hits++;
+  release(&zswap.lock);
+  return 0;
+}
+
+int
+zswap_has(int slot)
+{
+  return slotinfo(slot)->zpage != 0;
+}
+
+// Forget the pool copy of a swap slot being freed.
+void
+zswap_invalidate(int slot)
+{
+  acquire(&zswap.lock);
+  if(slotinfo(slot)->zpage)
+    zswap_drop(slot, 0);
+  release(&zswap.lock);
+}
+
+void
+zswap_getstat(struct zswapstat *st)
+{
+  acquire(&zswap.lock);
+  *st = zswap.stat;
+  release(&zswap.lock);
+}
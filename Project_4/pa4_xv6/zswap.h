@@ -0,0 +1,11 @@
+// Compressed swap pool statistics, returned by zswapstat().
+struct zswapstat {
+  int stored_pages;      // Pages currently held in the pool
+  int pool_pages;        // Physical pages the pool occupies
+  int compressed_bytes;  // Compressed bytes currently in the pool
+  int stores;            // Pages stored since boot
+  int hits;              // Swap-ins served from the pool
+  int rejects;           // Pages that compressed too poorly to keep
+  int pool_full;         // Pages sent to disk because the pool was full
+  int writebacks;        // Objects written to disk to make room
+};